@@ -22,6 +22,11 @@
 #include "abstract_decoder.h"
 #include "third_party/starboard/raspi/wayland/abstract_decoder.h"
 #include "third_party/starboard/raspi/wayland/player_private.h"
+#include "third_party/starboard/raspi/wayland/sample_pool.h"
+
+#include "starboard/time.h"
+
+#include "base/logging.h"
 
 #include <cmath>
 
@@ -31,13 +36,35 @@ GST_DEBUG_CATEGORY_STATIC (ABSTRACT_DECODER);
 AbstractDecoder::AbstractDecoder(SbPlayerPrivate& player, SbMediaType type)
   : Player(player),
     Type(type),
-    Source(gst_element_factory_make("appsrc", nullptr))
+    CapsUpdate(nullptr),
+    Caps(nullptr),
+    Generation(0),
+    KeyFramesOnly(0),
+    WrittenFrames(0),
+    SkippedFrames(0),
+    Sleeping(0),
+    WriterWaiting(0),
+    Flushing(1),
+    DemandFull(false),
+    DemandOutstanding(false)
 {
 }
 
 AbstractDecoder::~AbstractDecoder()
 {
-  gst_app_src_end_of_stream(GST_APP_SRC(Source));
+  // the pad task is stopped by now, see CobaltSourceUnregisterPlayer
+  PendingItem item;
+  while (Pending.Pop(&item)) {
+    if (item.Object) {
+      gst_mini_object_unref(item.Object);
+    }
+  }
+  if (CapsUpdate) {
+    gst_caps_unref(CapsUpdate);
+  }
+  if (Caps) {
+    gst_caps_unref(Caps);
+  }
   Player.ReportDecoderState(Type, kSbPlayerDecoderStateDestroyed);
 }
 
@@ -45,24 +72,15 @@ bool AbstractDecoder::Initialize()
 {
   GST_DEBUG_CATEGORY_INIT(ABSTRACT_DECODER, "ABSTRACT_DECODER", 0,
                           "Cobal Gstreamer Decoder");
-  // common source setup
-  GstAppSrcCallbacks callbacks
-    = { AbstractDecoder::NeedData,
-      AbstractDecoder::EnoughData,
-      AbstractDecoder::SeekData };
-  gst_app_src_set_callbacks(GST_APP_SRC(Source), &callbacks, this, nullptr);
-  g_object_set(GST_APP_SRC(Source), "format", GST_FORMAT_TIME, "stream-type",
-               GST_APP_STREAM_TYPE_SEEKABLE, nullptr);
-
   // custom part, includeng Caps initialization
   GstCaps* caps = CustomInitialize();
   if (caps == nullptr) {
     return false;
   }
-
-  // so we do not need to supply them with each chunk
-  gst_app_src_set_caps(GST_APP_SRC(Source), caps);
-  gst_caps_unref(caps);
+  // sent with the stream start, so we do not need to supply them with each
+  // chunk
+  starboard::ScopedLock lock(CapsMutex);
+  Caps = caps;
   return true;
 }
 
@@ -70,39 +88,374 @@ void AbstractDecoder::PushWorker(GstBuffer* buffer)
 {
   const size_t delta = gst_buffer_get_size(buffer);
   if (delta == 0) {
+    gst_buffer_unref(buffer);
     return;
   }
-  if (GST_FLOW_OK != gst_app_src_push_buffer(GST_APP_SRC(Source), buffer)) {
+  SbAtomicNoBarrier_Increment(&WrittenFrames, 1);
+  Buffering.OnQueued(GST_BUFFER_PTS(buffer));
+  if (SkipFrame(buffer)) {
     gst_buffer_unref(buffer);
+    SampleWritten();
     return;
   }
+  if (CapsUpdate) {
+    Enqueue(GST_MINI_OBJECT_CAST(CapsUpdate));
+    CapsUpdate = nullptr;
+  }
+  Enqueue(GST_MINI_OBJECT_CAST(buffer));
+  SampleWritten();
 }
 
+void AbstractDecoder::PushWorker(GstBufferList* list, bool applyCapsUpdate)
+{
+  if (gst_buffer_list_length(list) == 0) {
+    gst_buffer_list_unref(list);
+    return;
+  }
+  const guint length = gst_buffer_list_length(list);
+  SbAtomicNoBarrier_Increment(&WrittenFrames, length);
+  for (guint i = 0; i < length; ++i) {
+    Buffering.OnQueued(GST_BUFFER_PTS(gst_buffer_list_get(list, i)));
+  }
+  if (SbAtomicAcquire_Load(&KeyFramesOnly)) {
+    list = gst_buffer_list_make_writable(list);
+    for (guint i = 0; i < gst_buffer_list_length(list);) {
+      if (SkipFrame(gst_buffer_list_get(list, i))) {
+        gst_buffer_list_remove(list, i, 1);
+      }
+      else {
+        ++i;
+      }
+    }
+    if (gst_buffer_list_length(list) == 0) {
+      gst_buffer_list_unref(list);
+      SampleWritten();
+      return;
+    }
+  }
+  if (CapsUpdate && applyCapsUpdate) {
+    Enqueue(GST_MINI_OBJECT_CAST(CapsUpdate));
+    CapsUpdate = nullptr;
+  }
+  Enqueue(GST_MINI_OBJECT_CAST(list));
+  SampleWritten();
+}
 
 void AbstractDecoder::EosWorker()
 {
-  gst_app_src_end_of_stream(GST_APP_SRC(Source));
+  Enqueue(nullptr);
+  // nothing more to ask for till the next seek
+  starboard::ScopedLock lock(DemandMutex);
+  DemandOutstanding = true;
+}
+
+void AbstractDecoder::Flush()
+{
+  Buffering.Reset(SbAtomicBarrier_Increment(&Generation, 1));
+  OnFlush();
+  // no requests until the pipeline has been flushed, see SeekDone
+  starboard::ScopedLock lock(DemandMutex);
+  DemandFull = false;
+  DemandOutstanding = true;
 }
 
-// static
-void AbstractDecoder::NeedData(GstAppSrc*, guint, gpointer userData)
+void AbstractDecoder::SetKeyFramesOnly(bool keyFramesOnly)
 {
-  AbstractDecoder& decoder = *reinterpret_cast<AbstractDecoder*>(userData);
-  decoder.Player.ReportDecoderState(decoder.Type,
-                                    kSbPlayerDecoderStateNeedsData);
+  if (SbAtomicNoBarrier_Exchange(&KeyFramesOnly, keyFramesOnly ? 1 : 0)
+      != (keyFramesOnly ? 1 : 0)) {
+    // the retained samples would not decode into the other mode
+    Retained.Clear();
+  }
+  SbAtomicMemoryBarrier();
 }
 
-// static
-void AbstractDecoder::EnoughData(GstAppSrc*, gpointer userData)
+bool AbstractDecoder::SkipFrame(GstBuffer* buffer)
 {
-  return;
+  if (!SbAtomicAcquire_Load(&KeyFramesOnly)
+      || !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+    return false;
+  }
+  SbAtomicNoBarrier_Increment(&SkippedFrames, 1);
+  return true;
+}
+
+void AbstractDecoder::SeekDone()
+{
+  {
+    starboard::ScopedLock lock(DemandMutex);
+    DemandFull = false;
+    DemandOutstanding = false;
+  }
+  UpdateDemand();
+}
+
+void AbstractDecoder::RequestData()
+{
+  {
+    starboard::ScopedLock lock(DemandMutex);
+    if (DemandFull || DemandOutstanding) {
+      return;
+    }
+    DemandOutstanding = true;
+  }
+  // the callback itself is always made from the media thread
+  PlayerCommand command = PlayerCommand();
+  command.Type = PlayerCommand::kNeedsData;
+  command.Arguments[0] = Type;
+  command.Arguments[1] = SbAtomicAcquire_Load(&Generation);
+  Player.Post(command);
+}
+
+void AbstractDecoder::SampleWritten()
+{
+  {
+    starboard::ScopedLock lock(DemandMutex);
+    DemandOutstanding = false;
+  }
+  UpdateDemand();
+}
+
+void AbstractDecoder::UpdateDemand()
+{
+  const SbTime level = Buffering.GetLevel();
+  // only a safety net against a runaway writer, the amount of data is driven
+  // by media time
+  const bool enough = Pending.Size() >= kQueueCapacity / 2;
+  // samples held anywhere downstream, decoders included, released ones
+  // call this again
+  const bool overBudget = Player.Samples->IsOverBudget(Type);
+  {
+    starboard::ScopedLock lock(DemandMutex);
+    if (enough || overBudget || level >= Buffering.GetTarget()) {
+      DemandFull = true;
+    }
+    else if (level < Buffering.GetLow()) {
+      DemandFull = false;
+    }
+  }
+  RequestData();
+}
+
+void AbstractDecoder::DeliverNeedsData(SbAtomic32 generation)
+{
+  if (generation != SbAtomicAcquire_Load(&Generation)) {
+    // requested for the position before the last seek
+    return;
+  }
+  Player.ReportDecoderState(Type, kSbPlayerDecoderStateNeedsData);
+}
+
+void AbstractDecoder::UpdateCaps(GstCaps* caps)
+{
+  if (CapsUpdate) {
+    gst_caps_unref(CapsUpdate);
+  }
+  CapsUpdate = caps;
+}
+
+void AbstractDecoder::Enqueue(GstMiniObject* object)
+{
+  const PendingItem item = { object, SbAtomicNoBarrier_Load(&Generation) };
+  if (!Pending.Push(item)) {
+    // the demand keeps the ring half empty, a full one means the pad task
+    // stalls. the writer only waits for it that long
+    SB_DLOG(WARNING) << "push queue full, waiting for type " << Type;
+    const SbTime deadline = SbTimeGetMonotonicNow() + kMaxEnqueueWait;
+    do {
+      SbAtomicNoBarrier_Store(&WriterWaiting, 1);
+      // pairs with the barrier in WakeWriter, a freed slot is never missed
+      SbAtomicMemoryBarrier();
+      const SbTime left = deadline - SbTimeGetMonotonicNow();
+      if (left <= 0) {
+        SbAtomicNoBarrier_Store(&WriterWaiting, 0);
+        SB_LOG(ERROR) << "push queue of type " << Type << " stalled, "
+          << (object ? "sample" : "end of stream") << " dropped";
+        if (object) {
+          gst_mini_object_unref(object);
+        }
+        return;
+      }
+      if (Pending.Size() >= Pending.Capacity()) {
+        Room.TakeWait(left);
+      }
+      SbAtomicNoBarrier_Store(&WriterWaiting, 0);
+    } while (!Pending.Push(item));
+  }
+  Wake();
+}
+
+void AbstractDecoder::WakeWriter()
+{
+  SbAtomicMemoryBarrier();
+  if (SbAtomicNoBarrier_Exchange(&WriterWaiting, 0)) {
+    Room.Put();
+  }
+}
+
+void AbstractDecoder::Wake()
+{
+  // pairs with the barrier in Next, so a sleeping consumer is never missed
+  SbAtomicMemoryBarrier();
+  if (SbAtomicNoBarrier_Exchange(&Sleeping, 0)) {
+    Wakeup.Put();
+  }
+}
+
+bool AbstractDecoder::Next(GstMiniObject** object)
+{
+  while (!SbAtomicAcquire_Load(&Flushing)) {
+    // replayed samples go ahead of anything written after the seek
+    if (Retained.HasReplay()) {
+      GstMiniObject* replay = TakeReplay();
+      if (replay) {
+        *object = replay;
+        return true;
+      }
+      continue;
+    }
+    PendingItem item;
+    if (Pending.Pop(&item)) {
+      WakeWriter();
+      if (Take(item, object)) {
+        return true;
+      }
+      continue;
+    }
+    SbAtomicNoBarrier_Store(&Sleeping, 1);
+    SbAtomicMemoryBarrier();
+    if (Pending.Size() == 0 && !Retained.HasReplay()
+        && !SbAtomicAcquire_Load(&Flushing)) {
+      Wakeup.Take();
+    }
+    SbAtomicNoBarrier_Store(&Sleeping, 0);
+  }
+  return false;
+}
+
+void AbstractDecoder::SetFlushing(bool flushing)
+{
+  SbAtomicRelease_Store(&Flushing, flushing ? 1 : 0);
+  if (flushing) {
+    Wake();
+  }
+}
+
+void AbstractDecoder::OnSeek(GstClockTime position)
+{
+  Buffering.Reset(SbAtomicAcquire_Load(&Generation));
+  GstClockTime first;
+  GstClockTime last;
+  if (Retained.PrepareReplay(position, SbAtomicAcquire_Load(&Generation),
+                             &first, &last)) {
+    // the replayed range counts as queued, so Cobalt is only asked for
+    // more once it drains
+    Buffering.OnQueued(first);
+    Buffering.OnQueued(last);
+  }
+  SeekDone();
+}
+
+GstCaps* AbstractDecoder::GetCaps() const
+{
+  starboard::ScopedLock lock(CapsMutex);
+  return Caps ? gst_caps_ref(Caps) : nullptr;
+}
+
+int AbstractDecoder::GetBufferingPercent() const
+{
+  const SbTime target = Buffering.GetTarget();
+  const SbTime level = Buffering.GetLevel();
+  if (target <= 0 || level >= target) {
+    return 100;
+  }
+  return static_cast<int>(level * 100 / target);
+}
+
+bool AbstractDecoder::Take(const PendingItem& item, GstMiniObject** object)
+{
+  if (item.Generation != SbAtomicAcquire_Load(&Generation)) {
+    // written before the last seek
+    if (item.Object) {
+      gst_mini_object_unref(item.Object);
+    }
+    return false;
+  }
+  *object = item.Object;
+  if (!item.Object) {
+    return true;
+  }
+  if (GST_IS_CAPS(item.Object)) {
+    starboard::ScopedLock lock(CapsMutex);
+    // the caps are announced again after each seek. only a real change
+    // ends the window, the samples before it can't be replayed then
+    if (!Caps || !gst_caps_is_equal(Caps, GST_CAPS_CAST(item.Object))) {
+      Retained.Clear();
+    }
+    if (Caps) {
+      gst_caps_unref(Caps);
+    }
+    Caps = gst_caps_ref(GST_CAPS_CAST(item.Object));
+    return true;
+  }
+  if (GST_IS_BUFFER_LIST(item.Object)) {
+    GstBufferList* list = GST_BUFFER_LIST_CAST(item.Object);
+    if (Retained.IsEnabled()) {
+      list = gst_buffer_list_make_writable(list);
+      for (guint i = 0; i < gst_buffer_list_length(list);) {
+        GstBuffer* buffer = gst_buffer_list_get(list, i);
+        if (Retained.IsDuplicate(buffer)) {
+          gst_buffer_list_remove(list, i, 1);
+          continue;
+        }
+        if (!SbAtomicNoBarrier_Load(&KeyFramesOnly)) {
+          Retained.Add(buffer);
+        }
+        ++i;
+      }
+      if (gst_buffer_list_length(list) == 0) {
+        gst_buffer_list_unref(list);
+        return false;
+      }
+    }
+    Dequeued(gst_buffer_list_get(list, gst_buffer_list_length(list) - 1),
+             item.Generation);
+    *object = GST_MINI_OBJECT_CAST(list);
+    return true;
+  }
+  GstBuffer* buffer = GST_BUFFER_CAST(item.Object);
+  if (Retained.IsDuplicate(buffer)) {
+    // already pushed again from the window after the seek
+    gst_buffer_unref(buffer);
+    return false;
+  }
+  if (!SbAtomicNoBarrier_Load(&KeyFramesOnly)) {
+    Retained.Add(buffer);
+  }
+  Dequeued(buffer, item.Generation);
+  return true;
+}
+
+GstMiniObject* AbstractDecoder::TakeReplay()
+{
+  std::vector<GstBuffer*> buffers;
+  const SbAtomic32 generation = SbAtomicAcquire_Load(&Generation);
+  Retained.TakeReplay(generation, &buffers);
+  if (buffers.empty()) {
+    return nullptr;
+  }
+  // one push for the whole window
+  GstBufferList* list = gst_buffer_list_new_sized(buffers.size());
+  for (GstBuffer* buffer : buffers) {
+    gst_buffer_list_add(list, buffer);
+  }
+  Dequeued(buffers.back(), generation);
+  return GST_MINI_OBJECT_CAST(list);
 }
 
-// static
-gboolean AbstractDecoder::SeekData(GstAppSrc*, guint64, gpointer userData)
+// |buffer| of |generation| is about to be pushed downstream, the last one
+// of a list
+void AbstractDecoder::Dequeued(GstBuffer* buffer, SbAtomic32 generation)
 {
-  AbstractDecoder& decoder = *reinterpret_cast<AbstractDecoder*>(userData);
-  decoder.Player.ReportDecoderState(decoder.Type,
-                                    kSbPlayerDecoderStateNeedsData);
-  return TRUE;
+  Buffering.OnDequeued(GST_BUFFER_PTS(buffer), generation);
+  UpdateDemand();
 }
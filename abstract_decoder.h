@@ -21,10 +21,17 @@
 
 #pragma once
 
+#include "third_party/starboard/raspi/wayland/buffering_controller.h"
 #include "third_party/starboard/raspi/wayland/player_private.h"
+#include "third_party/starboard/raspi/wayland/sample_window.h"
+#include "third_party/starboard/raspi/wayland/spsc_ring.h"
+
+#include "starboard/atomic.h"
+#include "starboard/common/semaphore.h"
+#include "starboard/thread.h"
+#include "starboard/time.h"
 
 #include <gst/gst.h>
-#include <gst/app/gstappsrc.h>
 
 //#include "third_party/starboard/wayland/gstreamer_helpers.h"
 
@@ -39,24 +46,135 @@ public:
 
   bool Initialize();
 
+  // producer side, called from the thread writing samples. samples are only
+  // queued here, the cobaltsrc pad task pushes them downstream
   void PushWorker(GstBuffer* buffer);
+  // |applyCapsUpdate| false when the list still belongs to the old caps
+  void PushWorker(GstBufferList* list, bool applyCapsUpdate = true);
   void EosWorker();
+  // drops everything queued so far, used when seeking
+  void Flush();
+  // asks for data unless already full or a request is outstanding
+  void RequestData();
+  // the pipeline is at the new position, requests are allowed again
+  void SeekDone();
+  // checks the levels again and asks for data if they allow, any thread
+  void UpdateDemand();
+
+  // consumer side, the pad task of the cobaltsrc stream. waits for the next
+  // item to push: a buffer or buffer list, new caps, or null at the end of
+  // stream. returns false while flushing
+  bool Next(GstMiniObject** object);
+  // wakes up Next and fails it till cleared, to pause or stop the task
+  void SetFlushing(bool flushing);
+  // the stream restarts at |position| after a flushing seek
+  void OnSeek(GstClockTime position);
+  // caps the stream starts with, or the last ones pushed. new reference
+  GstCaps* GetCaps() const;
+  // media thread, raises NeedsData unless a seek came in between
+  void DeliverNeedsData(SbAtomic32 generation);
+
+  // while set only key frames are passed on, for trick play at high rates
+  void SetKeyFramesOnly(bool keyFramesOnly);
+  // samples written, and those of them skipped in key frame only mode
+  int GetWrittenFrames() const {
+    return SbAtomicNoBarrier_Load(&WrittenFrames);
+  }
+  int GetSkippedFrames() const {
+    return SbAtomicNoBarrier_Load(&SkippedFrames);
+  }
 
-  GstElement* GetElement() const {
-    return Source;
+  // fills in the buffer metadata (flags, DTS, duration) for a sample about
+  // to be written, |info| is only given for video
+  virtual void PrepareBuffer(GstBuffer* buffer,
+                             const SbMediaVideoSampleInfo* info) {}
+  // the last prepared buffer changed the stream caps
+  bool HasCapsUpdate() const {
+    return CapsUpdate != nullptr;
   }
 
+  // number of writes waiting for the pad task
+  int GetQueueLevel() const {
+    return Pending.Size();
+  }
+  static int GetQueueCapacity() {
+    return kQueueCapacity;
+  }
+
+  // media time written but not yet pushed downstream
+  SbTime GetBufferedDuration() const {
+    return Buffering.GetLevel();
+  }
+  // pts range of that media time, false while nothing is queued
+  bool GetBufferedRange(GstClockTime* start, GstClockTime* stop) const {
+    return Buffering.GetRange(start, stop);
+  }
+  // queued media time against the buffering target, 0 to 100
+  int GetBufferingPercent() const;
+
 protected:
   virtual GstCaps* CustomInitialize() = 0;
+  // called on the writing thread when queued samples are dropped
+  virtual void OnFlush() {}
 
-  static void NeedData(GstAppSrc*, guint, gpointer userData);
-  static void EnoughData(GstAppSrc*, gpointer userData);
-  static gboolean SeekData(GstAppSrc*, guint64, gpointer userData);
+  // new caps sent in order, ahead of the next written sample. takes ownership
+  void UpdateCaps(GstCaps* caps);
 
   SbPlayerPrivate& Player;
   const SbMediaType Type;
 
-  // not owning this element, just a reference
-  GstElement* Source;
+  BufferingController Buffering;
+
+private:
+  static const int kQueueCapacity = 256;
+  static const SbTime kMaxEnqueueWait = 100 * kSbTimeMillisecond;
+
+  // buffer, buffer list or caps, null marks the end of stream
+  struct PendingItem
+  {
+    GstMiniObject* Object;
+    SbAtomic32 Generation;
+  };
+
+  bool SkipFrame(GstBuffer* buffer);
+  // waits on Room while the ring is full, at most kMaxEnqueueWait, then
+  // drops |object|
+  void Enqueue(GstMiniObject* object);
+  void Wake();
+  // after a Pop, lets a writer blocked in Enqueue continue
+  void WakeWriter();
+  // false when |item| is dropped instead
+  bool Take(const PendingItem& item, GstMiniObject** object);
+  GstMiniObject* TakeReplay();
+  void Dequeued(GstBuffer* buffer, SbAtomic32 generation);
+  void SampleWritten();
+
+  SpscRing<PendingItem, kQueueCapacity> Pending;
+  GstCaps* CapsUpdate;
+  mutable starboard::Mutex CapsMutex;
+  GstCaps* Caps;
+  // bumped on flush, older items are dropped by the pad task
+  SbAtomic32 Generation;
+  SbAtomic32 KeyFramesOnly;
+  SbAtomic32 WrittenFrames;
+  SbAtomic32 SkippedFrames;
+  SbAtomic32 Sleeping;
+  // set while Enqueue waits for a slot of the ring
+  SbAtomic32 WriterWaiting;
+  SbAtomic32 Flushing;
+  starboard::Semaphore Wakeup;
+  starboard::Semaphore Room;
+
+  // recently delivered samples, owned by the pad task apart from
+  // PrepareReplay in OnSeek
+  SampleWindow Retained;
+
+  // demand state. Full is entered at the target level (or with the queue
+  // half full, or over the in flight budget of the sample pool) and left
+  // only below the low watermark. At most one
+  // NeedsData is outstanding until the next sample is written.
+  starboard::Mutex DemandMutex;
+  bool DemandFull;
+  bool DemandOutstanding;
 };
 
@@ -20,10 +20,13 @@
 //
 
 #include "third_party/starboard/raspi/wayland/audio_decoder.h"
+#include "third_party/starboard/raspi/wayland/media_capabilities.h"
+#include "third_party/starboard/raspi/wayland/media_preload.h"
 
 #include "starboard/shared/starboard/media/media_support_internal.h"
 
 #include <gst/gst.h>
+#include <gst/base/gstbitreader.h>
 
 #include <cstring>
 
@@ -43,12 +46,69 @@ const char* GetAudioCodecName(SbMediaAudioCodec codec)
   }
   return name;
 }
+
+// duration of one access unit, taken from the AudioSpecificConfig
+// (ISO 14496-3 1.6.2.1) and falling back to 1024 samples at |rate|
+GstClockTime GetAacFrameDuration(const void* config, int size, int rate)
+{
+  static const int kRates[] = { 96000, 88200, 64000, 48000, 44100, 32000,
+                                24000, 22050, 16000, 12000, 11025, 8000,
+                                7350 };
+  guint32 frameLength = 1024;
+  if (config && size >= 2) {
+    GstBitReader reader;
+    gst_bit_reader_init(&reader, reinterpret_cast<const guint8*>(config),
+                        size);
+    guint32 objectType = 0;
+    guint32 rateIndex = 0;
+    guint32 channels = 0;
+    bool ok = gst_bit_reader_get_bits_uint32(&reader, &objectType, 5);
+    if (ok && objectType == 31) {
+      ok = gst_bit_reader_get_bits_uint32(&reader, &objectType, 6);
+      objectType += 32;
+    }
+    ok = ok && gst_bit_reader_get_bits_uint32(&reader, &rateIndex, 4);
+    if (ok && rateIndex == 0xf) {
+      guint32 explicitRate = 0;
+      ok = gst_bit_reader_get_bits_uint32(&reader, &explicitRate, 24);
+      if (ok) {
+        rate = explicitRate;
+      }
+    }
+    else if (ok && rateIndex < G_N_ELEMENTS(kRates)) {
+      // core rate, SBR doubles both samples and rate so duration is the same
+      rate = kRates[rateIndex];
+    }
+    ok = ok && gst_bit_reader_get_bits_uint32(&reader, &channels, 4);
+    if (ok && (objectType == 5 || objectType == 29)) {
+      // explicit SBR/PS signalling, skip to the underlying object type
+      guint32 extensionIndex = 0;
+      ok = gst_bit_reader_get_bits_uint32(&reader, &extensionIndex, 4);
+      if (ok && extensionIndex == 0xf) {
+        ok = gst_bit_reader_skip(&reader, 24);
+      }
+      ok = ok && gst_bit_reader_get_bits_uint32(&reader, &objectType, 5);
+    }
+    guint32 shortFrame = 0;
+    // GASpecificConfig, frameLengthFlag selects 960 sample frames
+    if (ok && objectType >= 1 && objectType <= 4
+        && gst_bit_reader_get_bits_uint32(&reader, &shortFrame, 1)
+        && shortFrame) {
+      frameLength = 960;
+    }
+  }
+  if (rate <= 0) {
+    return GST_CLOCK_TIME_NONE;
+  }
+  return gst_util_uint64_scale_int(frameLength, GST_SECOND, rate);
+}
 }
 
 SB_EXPORT bool SbMediaIsAudioSupported(SbMediaAudioCodec audioCodec,
                                        int64_t bitrate) {
-  // there are problems with Opus in 16.2
-  const bool result = (audioCodec == kSbMediaAudioCodecAac)
+  MediaPreload::Wait();
+  // there are problems with Opus in 16.2, only AAC is probed
+  const bool result = MediaCapabilities::Get().IsAudioSupported(audioCodec)
     && bitrate >= 0ll
     && bitrate <= SB_MEDIA_MAX_AUDIO_BITRATE_IN_BITS_PER_SECOND;
   return result;
@@ -58,7 +118,8 @@ AudioDecoder::AudioDecoder(SbPlayerPrivate& player,
                            const SbMediaAudioSampleInfo* header)
   : AbstractDecoder(player, kSbMediaTypeAudio),
   Header(),
-  AudioSpecificConfig(nullptr)
+  AudioSpecificConfig(nullptr),
+  FrameDuration(GST_CLOCK_TIME_NONE)
 {
   if (header) {
     Header = *header;
@@ -68,12 +129,26 @@ AudioDecoder::AudioDecoder(SbPlayerPrivate& player,
       AudioSpecificConfig
         = gst_buffer_new_wrapped(copy, Header.audio_specific_config_size);
     }
+    FrameDuration = GetAacFrameDuration(Header.audio_specific_config,
+                                        Header.audio_specific_config_size,
+                                        Header.samples_per_second);
+  }
+}
+
+void AudioDecoder::PrepareBuffer(GstBuffer* buffer,
+                                 const SbMediaVideoSampleInfo*)
+{
+  // every audio frame is a sync point and decoded in presentation order
+  GST_BUFFER_DTS(buffer) = GST_BUFFER_PTS(buffer);
+  if (GST_CLOCK_TIME_IS_VALID(FrameDuration)) {
+    GST_BUFFER_DURATION(buffer) = FrameDuration;
   }
 }
 
 GstCaps* AudioDecoder::CustomInitialize()
 {
-  g_object_set(Source, "min-percent", 60u, "max-bytes", 64ull << 10, nullptr);
+  // the amount of data is driven by media time, see BufferingController
+  Buffering.Configure(Player.GetAudioCodec());
 
   gchar* capsString;
   GstCaps* caps = nullptr;
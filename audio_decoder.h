@@ -33,9 +33,14 @@ public:
   AudioDecoder(SbPlayerPrivate& player, const SbMediaAudioSampleInfo* header);
   virtual ~AudioDecoder() {};
 
+  virtual void PrepareBuffer(GstBuffer* buffer,
+                             const SbMediaVideoSampleInfo* info) override;
+
 private:
   virtual GstCaps* CustomInitialize() override;
   SbMediaAudioSampleInfo Header;
   GstBuffer* AudioSpecificConfig;
+  // every AAC access unit holds the same number of samples
+  GstClockTime FrameDuration;
 };
 
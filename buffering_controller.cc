@@ -0,0 +1,197 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/buffering_controller.h"
+
+#include "base/logging.h"
+
+#include <climits>
+
+namespace {
+
+struct VideoWatermarks
+{
+  // kSbMediaVideoCodecNone matches any codec
+  SbMediaVideoCodec Codec;
+  int MaxHeight;
+  int TargetMs;
+  int LowMs;
+};
+
+struct AudioWatermarks
+{
+  // kSbMediaAudioCodecNone matches any codec
+  SbMediaAudioCodec Codec;
+  int TargetMs;
+  int LowMs;
+};
+
+// first matching row wins, higher resolutions get less media time as every
+// second of it costs more memory
+const VideoWatermarks kVideoWatermarks[] = {
+  { kSbMediaVideoCodecH264, 480, 6000, 3000 },
+  { kSbMediaVideoCodecH264, 720, 5000, 2500 },
+  { kSbMediaVideoCodecH264, 1080, 4000, 2000 },
+  { kSbMediaVideoCodecH264, INT_MAX, 2500, 1200 },
+  { kSbMediaVideoCodecNone, 1080, 4000, 2000 },
+  { kSbMediaVideoCodecNone, INT_MAX, 2500, 1200 },
+};
+
+const AudioWatermarks kAudioWatermarks[] = {
+  { kSbMediaAudioCodecAac, 3000, 1500 },
+  { kSbMediaAudioCodecNone, 3000, 1500 },
+};
+
+// used while the frame height is not known yet
+const int kDefaultFrameHeight = 1080;
+
+SbTime GstTimeToSbTime(GstClockTime time)
+{
+  return static_cast<SbTime>(time / 1000);
+}
+
+} // anonymous namespace
+
+BufferingController::BufferingController()
+  : Target(kVideoWatermarks[0].TargetMs * kSbTimeMillisecond),
+  Low(kVideoWatermarks[0].LowMs * kSbTimeMillisecond),
+  Generation(0),
+  HasQueued(false),
+  HasDequeued(false),
+  FirstQueued(GST_CLOCK_TIME_NONE),
+  LastQueued(GST_CLOCK_TIME_NONE),
+  LastDequeued(GST_CLOCK_TIME_NONE)
+{
+}
+
+void BufferingController::Configure(SbMediaVideoCodec codec, int frameHeight)
+{
+  if (frameHeight <= 0) {
+    frameHeight = kDefaultFrameHeight;
+  }
+  for (const VideoWatermarks& w : kVideoWatermarks) {
+    if ((w.Codec == codec || w.Codec == kSbMediaVideoCodecNone)
+        && frameHeight <= w.MaxHeight) {
+      starboard::ScopedLock lock(Mutex);
+      Target = w.TargetMs * kSbTimeMillisecond;
+      Low = w.LowMs * kSbTimeMillisecond;
+      SB_DLOG(INFO) << "video buffering for height " << frameHeight
+        << " target " << w.TargetMs << "ms low " << w.LowMs << "ms";
+      return;
+    }
+  }
+}
+
+void BufferingController::Configure(SbMediaAudioCodec codec)
+{
+  for (const AudioWatermarks& w : kAudioWatermarks) {
+    if (w.Codec == codec || w.Codec == kSbMediaAudioCodecNone) {
+      starboard::ScopedLock lock(Mutex);
+      Target = w.TargetMs * kSbTimeMillisecond;
+      Low = w.LowMs * kSbTimeMillisecond;
+      return;
+    }
+  }
+}
+
+void BufferingController::Reset(SbAtomic32 generation)
+{
+  starboard::ScopedLock lock(Mutex);
+  Generation = generation;
+  HasQueued = false;
+  HasDequeued = false;
+  FirstQueued = GST_CLOCK_TIME_NONE;
+  LastQueued = GST_CLOCK_TIME_NONE;
+  LastDequeued = GST_CLOCK_TIME_NONE;
+}
+
+void BufferingController::OnQueued(GstClockTime pts)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+    return;
+  }
+  starboard::ScopedLock lock(Mutex);
+  if (!HasQueued) {
+    HasQueued = true;
+    FirstQueued = pts;
+    LastQueued = pts;
+  }
+  // samples may come slightly out of order
+  else if (pts > LastQueued) {
+    LastQueued = pts;
+  }
+}
+
+void BufferingController::OnDequeued(GstClockTime pts,
+                                     SbAtomic32 generation)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+    return;
+  }
+  starboard::ScopedLock lock(Mutex);
+  if (generation != Generation) {
+    return;
+  }
+  if (!HasDequeued || pts > LastDequeued) {
+    HasDequeued = true;
+    LastDequeued = pts;
+  }
+}
+
+SbTime BufferingController::GetLevel() const
+{
+  starboard::ScopedLock lock(Mutex);
+  if (!HasQueued) {
+    return 0;
+  }
+  const GstClockTime base = HasDequeued ? LastDequeued : FirstQueued;
+  if (LastQueued <= base) {
+    return 0;
+  }
+  return GstTimeToSbTime(LastQueued - base);
+}
+
+bool BufferingController::GetRange(GstClockTime* start,
+                                   GstClockTime* stop) const
+{
+  starboard::ScopedLock lock(Mutex);
+  if (!HasQueued) {
+    return false;
+  }
+  const GstClockTime base = HasDequeued ? LastDequeued : FirstQueued;
+  if (LastQueued < base) {
+    return false;
+  }
+  *start = base;
+  *stop = LastQueued;
+  return true;
+}
+
+SbTime BufferingController::GetTarget() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return Target;
+}
+
+SbTime BufferingController::GetLow() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return Low;
+}
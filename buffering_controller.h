@@ -0,0 +1,75 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+#include "starboard/common/mutex.h"
+#include "starboard/media.h"
+#include "starboard/time.h"
+
+#include <gst/gst.h>
+
+// Tracks how much media time of one stream is queued between WriteSample and
+// the cobaltsrc output, and compares it against watermarks expressed in time.
+// The watermarks come from a per codec (and for video per resolution) table,
+// so a 4K stream and a 480p stream both hold a sensible amount of playback.
+class BufferingController
+{
+public:
+  BufferingController();
+
+  // select watermarks, |frameHeight| is 0 while unknown
+  void Configure(SbMediaVideoCodec codec, int frameHeight);
+  void Configure(SbMediaAudioCodec codec);
+
+  // starts over with the writes of |generation|
+  void Reset(SbAtomic32 generation);
+  // sample entered the queue (producer thread)
+  void OnQueued(GstClockTime pts);
+  // sample written in |generation| left the queue (streaming thread). one
+  // of an older generation, still on its way when the reset came, is ignored
+  void OnDequeued(GstClockTime pts, SbAtomic32 generation);
+
+  // queued media time
+  SbTime GetLevel() const;
+  // pts of the oldest and newest sample still queued, false when empty
+  bool GetRange(GstClockTime* start, GstClockTime* stop) const;
+  SbTime GetTarget() const;
+  SbTime GetLow() const;
+
+  bool HasEnough() const {
+    return GetLevel() >= GetTarget();
+  }
+  bool IsLow() const {
+    return GetLevel() < GetLow();
+  }
+
+private:
+  mutable starboard::Mutex Mutex;
+  SbTime Target;
+  SbTime Low;
+  SbAtomic32 Generation;
+  bool HasQueued;
+  bool HasDequeued;
+  GstClockTime FirstQueued;
+  GstClockTime LastQueued;
+  GstClockTime LastDequeued;
+};
@@ -23,8 +23,6 @@
 #include "third_party/starboard/raspi/wayland/abstract_decoder.h"
 #include "starboard/log.h"
 
-#include <gst/app/gstappsrc.h>
-
 #define GST_COBALT_SRC_GET_PRIVATE(obj) \
   (G_TYPE_INSTANCE_GET_PRIVATE((obj), GST_COBALT_TYPE_SRC, GstCobaltSrcPrivate))
 
@@ -33,8 +31,39 @@ struct _GstCobaltSrcPrivate
   gchar* uri;
   guint pad_counter;
   gboolean configured;
+  // shared by the streams, so they are played together
+  guint group_id;
+};
+
+// the state of one src pad, owned by the pad
+struct CobaltStream
+{
+  AbstractDecoder* Decoder;
+  // not owning, the stream lives as long as the pad
+  GstPad* Pad;
+  GstSegment Segment;
+  guint32 Seqnum;
+  bool StartPending;
+  bool SegmentPending;
 };
 
+static GQuark StreamQuark()
+{
+  static GQuark quark = g_quark_from_static_string("cobalt-stream");
+  return quark;
+}
+
+static CobaltStream* GetStream(GstPad* pad)
+{
+  return reinterpret_cast<CobaltStream*>(
+    g_object_get_qdata(G_OBJECT(pad), StreamQuark()));
+}
+
+static void FreeStream(gpointer stream)
+{
+  delete reinterpret_cast<CobaltStream*>(stream);
+}
+
 enum
 {
   PROP_0, PROP_LOCATION
@@ -56,11 +85,13 @@ static void CobaltSourceSetProperty(
 static void CobaltSourceGetProperty(
   GObject*, guint propertyID, GValue*, GParamSpec*);
 static GstStateChangeReturn CobaltSourceStateChange(GstElement*, GstStateChange);
-static void CobaltSourceHandleMessage(GstBin*, GstMessage*);
-static gboolean CobaltSourceQueryWithParent(GstPad*, GstObject*, GstQuery*);
+static gboolean CobaltSourceActivateMode(GstPad*, GstObject*, GstPadMode,
+                                         gboolean active);
+static gboolean CobaltSourceEvent(GstPad*, GstObject*, GstEvent*);
+static gboolean CobaltSourceQuery(GstPad*, GstObject*, GstQuery*);
 
 #define gst_cobalt_src_parent_class parent_class
-G_DEFINE_TYPE_WITH_CODE(GstCobaltSrc, gst_cobalt_src, GST_TYPE_BIN,
+G_DEFINE_TYPE_WITH_CODE(GstCobaltSrc, gst_cobalt_src, GST_TYPE_ELEMENT,
   G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, UriHandlerInit);
   GST_DEBUG_CATEGORY_INIT(gst_cobalt_src_debug, "cobaltsrc", 0,
                           "cobalt source element"););
@@ -70,7 +101,6 @@ static void gst_cobalt_src_class_init(GstCobaltSrcClass* klass)
 {
   GObjectClass* oklass = G_OBJECT_CLASS(klass);
   GstElementClass* eklass = GST_ELEMENT_CLASS(klass);
-  GstBinClass* bklass = GST_BIN_CLASS(klass);
 
   oklass->dispose = CobaltSourceDispose;
   oklass->finalize = CobaltSourceFinalize;
@@ -88,7 +118,6 @@ static void gst_cobalt_src_class_init(GstCobaltSrcClass* klass)
     g_param_spec_string("location", "location", "Location to read from", 0,
       (GParamFlags)(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS)));
   eklass->change_state = GST_DEBUG_FUNCPTR(CobaltSourceStateChange);
-  bklass->handle_message = GST_DEBUG_FUNCPTR(CobaltSourceHandleMessage);
   g_type_class_add_private(klass, sizeof(GstCobaltSrcPrivate));
 }
 
@@ -99,7 +128,8 @@ static void gst_cobalt_src_init(GstCobaltSrc* src)
   src->priv->configured = FALSE;
   src->priv->pad_counter = 0;
   src->priv->uri = nullptr;
-  g_object_set(GST_BIN(src), "message-forward", TRUE, nullptr);
+  src->priv->group_id = gst_util_group_id_next();
+  GST_OBJECT_FLAG_SET(src, GST_ELEMENT_FLAG_SOURCE);
 }
 
 static void CobaltSourceDispose(GObject* object)
@@ -220,63 +250,257 @@ static void UriHandlerInit(gpointer interface, gpointer)
   i.set_uri = UriSetUri;
 }
 
-static gboolean CobaltSourceQueryWithParent(
-  GstPad* pad, GstObject* parent, GstQuery* query)
+static void PushEndOfStream(CobaltStream* stream)
 {
-  gboolean result = FALSE;
+  GstEvent* event = gst_event_new_eos();
+  if (stream->Seqnum) {
+    gst_event_set_seqnum(event, stream->Seqnum);
+  }
+  gst_pad_push_event(stream->Pad, event);
+}
+
+// the pad task, one item of the decoder queue per iteration
+static void CobaltSourceLoop(gpointer data)
+{
+  CobaltStream* stream = reinterpret_cast<CobaltStream*>(data);
+  GstPad* pad = stream->Pad;
+  GstElement* element = GST_PAD_PARENT(pad);
+
+  if (stream->StartPending) {
+    gchar* id = gst_pad_create_stream_id(pad, element, GST_PAD_NAME(pad));
+    GstEvent* event = gst_event_new_stream_start(id);
+    g_free(id);
+    gst_event_set_group_id(event, GST_COBALT_SRC(element)->priv->group_id);
+    gst_pad_push_event(pad, event);
+    GstCaps* caps = stream->Decoder->GetCaps();
+    if (caps) {
+      gst_pad_push_event(pad, gst_event_new_caps(caps));
+      gst_caps_unref(caps);
+    }
+    stream->StartPending = false;
+  }
+  if (stream->SegmentPending) {
+    GstEvent* event = gst_event_new_segment(&stream->Segment);
+    if (stream->Seqnum) {
+      gst_event_set_seqnum(event, stream->Seqnum);
+    }
+    gst_pad_push_event(pad, event);
+    stream->SegmentPending = false;
+  }
 
-  GstPad* target = gst_ghost_pad_get_target(GST_GHOST_PAD_CAST(pad));
-  // Forward the query to the proxy target pad.
-  if (target) {
-    result = gst_pad_query(target, query);
+  GstMiniObject* object = nullptr;
+  if (!stream->Decoder->Next(&object)) {
+    // flushing, a seek or the deactivation takes over
+    gst_pad_pause_task(pad);
+    return;
+  }
+  GstFlowReturn result = GST_FLOW_OK;
+  if (!object) {
+    GST_DEBUG_OBJECT(pad, "end of stream");
+    PushEndOfStream(stream);
+    gst_pad_pause_task(pad);
+    return;
+  }
+  if (GST_IS_CAPS(object)) {
+    GstCaps* caps = GST_CAPS_CAST(object);
+    gst_pad_push_event(pad, gst_event_new_caps(caps));
+    gst_caps_unref(caps);
+  }
+  else if (GST_IS_BUFFER_LIST(object)) {
+    GstBufferList* list = GST_BUFFER_LIST_CAST(object);
+    GstBuffer* last
+      = gst_buffer_list_get(list, gst_buffer_list_length(list) - 1);
+    if (GST_BUFFER_PTS_IS_VALID(last)) {
+      stream->Segment.position = GST_BUFFER_PTS(last);
+    }
+    result = gst_pad_push_list(pad, list);
+  }
+  else {
+    GstBuffer* buffer = GST_BUFFER_CAST(object);
+    if (GST_BUFFER_PTS_IS_VALID(buffer)) {
+      stream->Segment.position = GST_BUFFER_PTS(buffer);
+    }
+    result = gst_pad_push(pad, buffer);
+  }
+
+  if (result != GST_FLOW_OK) {
+    GST_DEBUG_OBJECT(pad, "pausing task, reason %s",
+                     gst_flow_get_name(result));
+    if (result == GST_FLOW_EOS) {
+      PushEndOfStream(stream);
+    }
+    else if (result == GST_FLOW_NOT_LINKED || result < GST_FLOW_EOS) {
+      GST_ELEMENT_ERROR(element, STREAM, FAILED,
+        ("Internal data stream error."),
+        ("streaming stopped, reason %s", gst_flow_get_name(result)));
+      PushEndOfStream(stream);
+    }
+    gst_pad_pause_task(pad);
+  }
+}
+
+static gboolean CobaltSourceActivateMode(GstPad* pad, GstObject*,
+                                         GstPadMode mode, gboolean active)
+{
+  CobaltStream* stream = GetStream(pad);
+  if (mode != GST_PAD_MODE_PUSH || !stream) {
+    return FALSE;
+  }
+  if (active) {
+    gst_segment_init(&stream->Segment, GST_FORMAT_TIME);
+    stream->Seqnum = 0;
+    stream->StartPending = true;
+    stream->SegmentPending = true;
+    stream->Decoder->SetFlushing(false);
+    return gst_pad_start_task(pad, CobaltSourceLoop, stream, nullptr);
+  }
+  // the pad is flushing already, so a push in progress returns as well
+  stream->Decoder->SetFlushing(true);
+  return gst_pad_stop_task(pad);
+}
+
+static gboolean CobaltSourceSeek(CobaltStream* stream, GstEvent* event)
+{
+  gdouble rate;
+  GstFormat format;
+  GstSeekFlags flags;
+  GstSeekType startType;
+  GstSeekType stopType;
+  gint64 start;
+  gint64 stop;
+  gst_event_parse_seek(event, &rate, &format, &flags, &startType, &start,
+                       &stopType, &stop);
+  if (format != GST_FORMAT_TIME || rate <= 0.0) {
+    GST_DEBUG_OBJECT(stream->Pad, "unsupported seek");
+    return FALSE;
+  }
+  GstPad* pad = stream->Pad;
+  const guint32 seqnum = gst_event_get_seqnum(event);
+  const bool flush = (flags & GST_SEEK_FLAG_FLUSH) != 0;
+  if (flush) {
+    GstEvent* flushStart = gst_event_new_flush_start();
+    gst_event_set_seqnum(flushStart, seqnum);
+    gst_pad_push_event(pad, flushStart);
+  }
+  // out of the wait for samples, then out of the loop
+  stream->Decoder->SetFlushing(true);
+  gst_pad_pause_task(pad);
+
+  GST_PAD_STREAM_LOCK(pad);
+  if (flush) {
+    GstEvent* flushStop = gst_event_new_flush_stop(TRUE);
+    gst_event_set_seqnum(flushStop, seqnum);
+    gst_pad_push_event(pad, flushStop);
+  }
+  // without a flush the new segment continues from the last position
+  gboolean update;
+  gst_segment_do_seek(&stream->Segment, rate, format, flags, startType, start,
+                      stopType, stop, &update);
+  stream->Seqnum = seqnum;
+  stream->SegmentPending = true;
+  if (flush && startType == GST_SEEK_TYPE_SET) {
+    stream->Decoder->OnSeek(start);
   }
-  gst_object_unref(target);
+  if (GST_PAD_IS_ACTIVE(pad)) {
+    stream->Decoder->SetFlushing(false);
+    gst_pad_start_task(pad, CobaltSourceLoop, stream, nullptr);
+  }
+  GST_PAD_STREAM_UNLOCK(pad);
+  return TRUE;
+}
+
+static gboolean CobaltSourceEvent(GstPad* pad, GstObject*, GstEvent* event)
+{
+  gboolean result = FALSE;
+  switch (GST_EVENT_TYPE(event))
+  {
+  case GST_EVENT_SEEK:
+    result = CobaltSourceSeek(GetStream(pad), event);
+    break;
+  case GST_EVENT_QOS:
+  case GST_EVENT_LATENCY:
+  case GST_EVENT_RECONFIGURE:
+    // nothing to adjust, samples are pushed as soon as written
+    result = TRUE;
+    break;
+  default:
+    break;
+  }
+  gst_event_unref(event);
   return result;
 }
 
-static void CobaltSourceHandleMessage(GstBin* bin, GstMessage* message)
+// answered from the samples queued in the decoder, what is already
+// downstream is reported by the queues there
+static gboolean CobaltSourceBufferingQuery(AbstractDecoder* decoder,
+                                           GstQuery* query)
 {
-  GstCobaltSrc* src = GST_COBALT_SRC(GST_ELEMENT(bin));
+  GstFormat format;
+  gst_query_parse_buffering_range(query, &format, nullptr, nullptr, nullptr);
+  const int percent = decoder->GetBufferingPercent();
+  gst_query_set_buffering_percent(query, percent < 100, percent);
+  gst_query_set_buffering_stats(query, GST_BUFFERING_STREAM, -1, -1, -1);
+
+  // the duration is unknown, so is the range as percentage
+  GstClockTime start;
+  GstClockTime stop;
+  if (format != GST_FORMAT_TIME || !decoder->GetBufferedRange(&start, &stop)) {
+    gst_query_set_buffering_range(query, format, -1, -1, -1);
+    return TRUE;
+  }
+  gst_query_set_buffering_range(query, GST_FORMAT_TIME, start, stop, -1);
+  gst_query_add_buffering_range(query, start, stop);
+  return TRUE;
+}
 
-  switch (GST_MESSAGE_TYPE(message))
+static gboolean CobaltSourceQuery(GstPad* pad, GstObject* parent,
+                                  GstQuery* query)
+{
+  switch (GST_QUERY_TYPE(query))
   {
-  case GST_MESSAGE_EOS:
+  case GST_QUERY_SCHEDULING:
+    gst_query_set_scheduling(query, GST_SCHEDULING_FLAG_SEEKABLE, 1, -1, 0);
+    gst_query_add_scheduling_mode(query, GST_PAD_MODE_PUSH);
+    return TRUE;
+  case GST_QUERY_SEEKING:
     {
-      gboolean emit_eos = TRUE;
-      GstPad* pad = gst_element_get_static_pad(
-        GST_ELEMENT(GST_MESSAGE_SRC(message)), "src");
-
-      GST_DEBUG_OBJECT(src, "EOS received from %s",
-                       GST_MESSAGE_SRC_NAME(message));
-      g_object_set_data(G_OBJECT(pad), "is-eos", GINT_TO_POINTER(1));
-      gst_object_unref(pad);
-      for (guint i = 0; i < src->priv->pad_counter; ++i) {
-        gchar* name = g_strdup_printf("src_%u", i);
-        GstPad* src_pad = gst_element_get_static_pad(GST_ELEMENT(src), name);
-        GstPad* target = gst_ghost_pad_get_target(GST_GHOST_PAD_CAST(src_pad));
-        gint is_eos
-          = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(target), "is-eos"));
-        gst_object_unref(target);
-        gst_object_unref(src_pad);
-        g_free(name);
-
-        if (!is_eos)
-        {
-          emit_eos = FALSE;
-          break;
-        }
+      GstFormat format;
+      gst_query_parse_seeking(query, &format, nullptr, nullptr, nullptr);
+      if (format != GST_FORMAT_TIME) {
+        return FALSE;
       }
-      gst_message_unref(message);
-      if (emit_eos) {
-        GST_DEBUG_OBJECT(src,
-                         "All appsrc elements are EOS, emitting event now.");
-        gst_element_send_event(GST_ELEMENT(bin), gst_event_new_eos());
+      // Cobalt serves any position, the length is not known here
+      gst_query_set_seeking(query, GST_FORMAT_TIME, TRUE, 0, -1);
+      return TRUE;
+    }
+  case GST_QUERY_BUFFERING:
+    return CobaltSourceBufferingQuery(GetStream(pad)->Decoder, query);
+  case GST_QUERY_LATENCY:
+    gst_query_set_latency(query, FALSE, 0, GST_CLOCK_TIME_NONE);
+    return TRUE;
+  case GST_QUERY_CAPS:
+    {
+      GstCaps* caps = gst_pad_get_current_caps(pad);
+      if (!caps) {
+        caps = GetStream(pad)->Decoder->GetCaps();
       }
-      break;
+      if (!caps) {
+        caps = gst_pad_get_pad_template_caps(pad);
+      }
+      GstCaps* filter = nullptr;
+      gst_query_parse_caps(query, &filter);
+      if (filter) {
+        GstCaps* intersection
+          = gst_caps_intersect_full(filter, caps, GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref(caps);
+        caps = intersection;
+      }
+      gst_query_set_caps_result(query, caps);
+      gst_caps_unref(caps);
+      return TRUE;
     }
   default:
-    GST_BIN_CLASS(parent_class)->handle_message(bin, message);
-    break;
+    return gst_pad_query_default(pad, parent, query);
   }
 }
 
@@ -289,33 +513,54 @@ void CobaltSourceRegisterPlayer(GstElement* element,
   AbstractDecoder* const decoders[] = { audioDecoder, videoDecoder };
 
   for (AbstractDecoder* d : decoders) {
-    //register audio buffer player
+    if (!d) {
+      continue;
+    }
     gchar* name = g_strdup_printf("src_%u", src->priv->pad_counter);
     ++(src->priv->pad_counter);
 
     SB_DLOG(INFO) << "Registering player " << reinterpret_cast<void*>(d)
       << " on pad " << name;
 
-    GstElement* appsrc = d->GetElement();
-    gst_bin_add(GST_BIN(element), appsrc);
-    GstPad* target = gst_element_get_static_pad(appsrc, "src");
-    GstPad* pad = gst_ghost_pad_new(name, target);
-
-    gst_pad_set_query_function(pad, CobaltSourceQueryWithParent);
-    gst_pad_set_active(pad, TRUE);
-
-    gst_element_add_pad(element, pad);
+    GstPad* pad = gst_pad_new_from_static_template(&SourceTemplate, name);
+    CobaltStream* stream = new CobaltStream();
+    stream->Decoder = d;
+    stream->Pad = pad;
+    gst_segment_init(&stream->Segment, GST_FORMAT_TIME);
+    g_object_set_qdata_full(G_OBJECT(pad), StreamQuark(), stream,
+                            &FreeStream);
+    gst_pad_set_activatemode_function(pad, CobaltSourceActivateMode);
+    gst_pad_set_event_function(pad, CobaltSourceEvent);
+    gst_pad_set_query_function(pad, CobaltSourceQuery);
     GST_OBJECT_FLAG_SET(pad, GST_PAD_FLAG_NEED_PARENT);
 
-    gst_element_sync_state_with_parent(appsrc);
+    gst_element_add_pad(element, pad);
+    // the state change only activates the pads present at the time
+    if (GST_STATE_TARGET(element) >= GST_STATE_PAUSED) {
+      gst_pad_set_active(pad, TRUE);
+    }
 
     g_free(name);
-    gst_object_unref(target);
   }
   gst_element_no_more_pads(element);
   src->priv->configured = TRUE;
 }
 
+GstPad* CobaltSourceGetPad(GstElement* element, AbstractDecoder* decoder)
+{
+  GstPad* pad = nullptr;
+  GST_OBJECT_LOCK(element);
+  for (GList* l = element->srcpads; l; l = l->next) {
+    CobaltStream* stream = GetStream(GST_PAD_CAST(l->data));
+    if (stream && stream->Decoder == decoder) {
+      pad = GST_PAD_CAST(gst_object_ref(l->data));
+      break;
+    }
+  }
+  GST_OBJECT_UNLOCK(element);
+  return pad;
+}
+
 void CobaltSourceUnregisterPlayer(GstElement* element,
                                   AbstractDecoder* audioDecoder,
                                   AbstractDecoder* videoDecoder)
@@ -327,39 +572,25 @@ void CobaltSourceUnregisterPlayer(GstElement* element,
     if (!d) {
       continue;
     }
-    //unregister audio buffer player
-    GstElement* appsrc = d->GetElement();
-    GstPad* pad = gst_element_get_static_pad(appsrc, "src");
-    GstPad* peer = gst_pad_get_peer(pad);
-
-    SB_DLOG(INFO) << "Unregistering audio_player from pad "
-      << GST_PAD_NAME(pad) << ", appsrc: "
-      << reinterpret_cast<void*>(appsrc);
-
-    if (!peer) {
+    GstPad* pad = CobaltSourceGetPad(element, d);
+    if (!pad) {
       continue;
     }
 
-    GstPad* ghost
-      = GST_PAD_CAST(gst_proxy_pad_get_internal(GST_PROXY_PAD(peer)));
-
-    if (!ghost) {
-      continue;
-    }
-    gst_ghost_pad_set_target(GST_GHOST_PAD_CAST(ghost), nullptr);
-    gst_element_remove_pad(element, ghost);
-    gst_object_unref(ghost);
-    gst_object_unref(peer);
+    SB_DLOG(INFO) << "Unregistering player " << reinterpret_cast<void*>(d)
+      << " from pad " << GST_PAD_NAME(pad);
 
-    gst_element_set_state(appsrc, GST_STATE_NULL);
-    gst_bin_remove(GST_BIN(src), appsrc);
+    // stops the task, the decoder is not used after this
+    gst_pad_set_active(pad, FALSE);
+    gst_element_remove_pad(element, pad);
+    gst_object_unref(pad);
 
     if (src->priv->pad_counter > 0) {
       --(src->priv->pad_counter);
     }
   }
 
-  if (GST_BIN_NUMCHILDREN(src) == 0) {
+  if (element->numsrcpads == 0) {
     GST_DEBUG_OBJECT(src, "No player left, unconfiguring");
     src->priv->configured = FALSE;
   }
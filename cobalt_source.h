@@ -40,15 +40,17 @@ typedef struct _GstCobaltSrc GstCobaltSrc;
 typedef struct _GstCobaltSrcClass GstCobaltSrcClass;
 typedef struct _GstCobaltSrcPrivate GstCobaltSrcPrivate;
 
+// One src pad per registered decoder, each with a task pushing the samples
+// the decoder queued straight downstream.
 struct _GstCobaltSrc
 {
-  GstBin parent;
+  GstElement parent;
   GstCobaltSrcPrivate *priv;
 };
 
 struct _GstCobaltSrcClass
 {
-  GstBinClass parentClass;
+  GstElementClass parentClass;
 };
 
 GType gst_cobalt_src_get_type(void);
@@ -58,5 +60,7 @@ void CobaltSourceRegisterPlayer(GstElement*,
 void CobaltSourceUnregisterPlayer(GstElement*,
                                   AbstractDecoder*, AbstractDecoder*);
 gboolean CobaltSourceIsConfigured(GstElement*);
+// the src pad of a registered decoder, new reference or nullptr
+GstPad* CobaltSourceGetPad(GstElement*, AbstractDecoder*);
 G_END_DECLS
 
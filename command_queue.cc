@@ -0,0 +1,227 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/command_queue.h"
+
+#include "starboard/thread.h"
+#include "starboard/time.h"
+
+#include "base/logging.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+struct CommandSource
+{
+  GSource Source;
+  CommandQueue* Queue;
+  gpointer Tag;
+};
+
+} // anonymous namespace
+
+// glue between the GSource callbacks and the queue internals
+struct CommandSourceGlue
+{
+  static gboolean Check(GSource* source)
+  {
+    CommandSource* s = reinterpret_cast<CommandSource*>(source);
+    return (g_source_query_unix_fd(source, s->Tag) & G_IO_IN) ? TRUE : FALSE;
+  }
+
+  static gboolean Dispatch(GSource* source, GSourceFunc, gpointer)
+  {
+    reinterpret_cast<CommandSource*>(source)->Queue->Drain();
+    return G_SOURCE_CONTINUE;
+  }
+};
+
+namespace {
+
+GSourceFuncs CommandSourceFuncs = {
+  nullptr,
+  CommandSourceGlue::Check,
+  CommandSourceGlue::Dispatch,
+  nullptr
+};
+
+} // anonymous namespace
+
+CommandQueue::CommandQueue()
+  : EnqueuePosition(0),
+  DequeuePosition(0),
+  Signalled(0),
+  EventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+  Source(nullptr),
+  CommandHandler(nullptr),
+  HandlerContext(nullptr),
+  Coalesced(0)
+{
+  SB_DCHECK(EventFd >= 0);
+  for (int i = 0; i < kCapacity; ++i) {
+    SbAtomicNoBarrier_Store(&Cells[i].Sequence, i);
+  }
+  SbAtomicMemoryBarrier();
+}
+
+CommandQueue::~CommandQueue()
+{
+  Detach();
+  if (EventFd >= 0) {
+    close(EventFd);
+  }
+}
+
+void CommandQueue::Attach(GMainContext* context,
+                          Handler handler,
+                          void* handlerContext)
+{
+  SB_DCHECK(!Source);
+  CommandHandler = handler;
+  HandlerContext = handlerContext;
+  Source = g_source_new(&CommandSourceFuncs, sizeof(CommandSource));
+  CommandSource* s = reinterpret_cast<CommandSource*>(Source);
+  s->Queue = this;
+  s->Tag = g_source_add_unix_fd(Source, EventFd, G_IO_IN);
+  g_source_set_priority(Source, G_PRIORITY_HIGH);
+  g_source_attach(Source, context);
+}
+
+void CommandQueue::Detach()
+{
+  if (Source) {
+    g_source_destroy(Source);
+    g_source_unref(Source);
+    Source = nullptr;
+  }
+}
+
+void CommandQueue::Post(const PlayerCommand& command)
+{
+  PlayerCommand stamped = command;
+  stamped.Posted = SbTimeGetMonotonicNow();
+  if (!Push(stamped)) {
+    if (Source && g_main_context_is_owner(g_source_get_context(Source))) {
+      // posted by a handler, nobody else would drain the queue. the queued
+      // commands go first, so the order stays
+      SB_LOG(WARNING) << "command queue full on its own thread";
+      Drain();
+      CommandHandler(stamped, HandlerContext);
+      return;
+    }
+    SB_DLOG(WARNING) << "command queue full, waiting";
+    do {
+      SbThreadSleep(kSbTimeMillisecond);
+    } while (!Push(stamped));
+  }
+  // pairs with the barrier in Drain, one write wakes up for the whole burst
+  SbAtomicMemoryBarrier();
+  if (SbAtomicNoBarrier_Exchange(&Signalled, 1) == 0) {
+    const uint64_t one = 1;
+    if (write(EventFd, &one, sizeof(one)) != sizeof(one)) {
+      SB_DLOG(ERROR) << "failed to signal the command queue";
+    }
+  }
+}
+
+// bounded queue with a sequence number per cell, see Dmitry Vyukov's MPMC
+bool CommandQueue::Push(const PlayerCommand& command)
+{
+  uint32_t position
+    = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&EnqueuePosition));
+  Cell* cell;
+  for (;;) {
+    cell = &Cells[position & (kCapacity - 1)];
+    const uint32_t sequence
+      = static_cast<uint32_t>(SbAtomicAcquire_Load(&cell->Sequence));
+    const int32_t difference = static_cast<int32_t>(sequence - position);
+    if (difference == 0) {
+      const SbAtomic32 previous = SbAtomicNoBarrier_CompareAndSwap(
+        &EnqueuePosition, static_cast<SbAtomic32>(position),
+        static_cast<SbAtomic32>(position + 1));
+      if (static_cast<uint32_t>(previous) == position) {
+        break;
+      }
+      position = static_cast<uint32_t>(previous);
+    }
+    else if (difference < 0) {
+      return false;
+    }
+    else {
+      position
+        = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&EnqueuePosition));
+    }
+  }
+  cell->Command = command;
+  SbAtomicRelease_Store(&cell->Sequence,
+                        static_cast<SbAtomic32>(position + 1));
+  return true;
+}
+
+bool CommandQueue::Peek(PlayerCommand::Kind* kind) const
+{
+  const Cell* cell = &Cells[DequeuePosition & (kCapacity - 1)];
+  const uint32_t sequence
+    = static_cast<uint32_t>(SbAtomicAcquire_Load(&cell->Sequence));
+  if (static_cast<int32_t>(sequence - (DequeuePosition + 1)) < 0) {
+    return false;
+  }
+  *kind = cell->Command.Type;
+  return true;
+}
+
+bool CommandQueue::Pop(PlayerCommand* command)
+{
+  Cell* cell = &Cells[DequeuePosition & (kCapacity - 1)];
+  const uint32_t sequence
+    = static_cast<uint32_t>(SbAtomicAcquire_Load(&cell->Sequence));
+  if (static_cast<int32_t>(sequence - (DequeuePosition + 1)) < 0) {
+    return false;
+  }
+  *command = cell->Command;
+  SbAtomicRelease_Store(&cell->Sequence,
+                        static_cast<SbAtomic32>(DequeuePosition + kCapacity));
+  ++DequeuePosition;
+  return true;
+}
+
+void CommandQueue::Drain()
+{
+  uint64_t value;
+  if (read(EventFd, &value, sizeof(value)) < 0) {
+    // spurious, nothing written since the last read
+  }
+  SbAtomicNoBarrier_Store(&Signalled, 0);
+  SbAtomicMemoryBarrier();
+
+  PlayerCommand command;
+  PlayerCommand::Kind next;
+  while (Pop(&command)) {
+    if (IsCoalesced(command.Type) && Peek(&next) && next == command.Type) {
+      // replaced by the one right after, any other command in between
+      // may depend on it
+      ++Coalesced;
+      continue;
+    }
+    CommandHandler(command, HandlerContext);
+  }
+}
@@ -0,0 +1,114 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+
+#include <glib.h>
+
+#include <cstdint>
+
+// fixed size control command for the media thread
+struct PlayerCommand
+{
+  enum Kind
+  {
+    kSeek,          // Time, Arguments[0] ticket
+    kBounds,        // Arguments z, x, y, width, height
+    kPlaybackRate,  // Value
+    kVolume,        // Value
+    kNeedsData,     // Arguments[0] media type, Arguments[1] generation
+    kPlayerState,   // Arguments[0] state
+    kSignal,        // Pointer to a starboard::Semaphore
+    kFirstFrame,    // Time the frame reached the video sink
+    kKindCount
+  };
+
+  Kind Type;
+  int64_t Time;
+  double Value;
+  int Arguments[5];
+  void* Pointer;
+  // stamped by the queue, monotonic time of posting
+  int64_t Posted;
+};
+
+// Bounded lock free multi producer / single consumer queue of commands,
+// drained on a GMainContext after a single eventfd wakeup. Posting never
+// allocates or takes a lock. Bounds, playback rate and volume only matter
+// in their latest version, so one directly followed by another of its kind
+// is skipped.
+class CommandQueue
+{
+public:
+  typedef void (*Handler)(const PlayerCommand& command, void* context);
+
+  CommandQueue();
+  ~CommandQueue();
+
+  // any thread
+  void Post(const PlayerCommand& command);
+
+  // |handler| is called for each command on the thread running |context|
+  void Attach(GMainContext* context, Handler handler, void* handlerContext);
+  void Detach();
+
+  uint64_t GetCoalesced() const {
+    return Coalesced;
+  }
+
+private:
+  static const int kCapacity = 256;
+
+  struct Cell
+  {
+    SbAtomic32 Sequence;
+    PlayerCommand Command;
+  };
+
+  friend struct CommandSourceGlue;
+  bool Push(const PlayerCommand& command);
+  // the kind of the next command, if it is ready
+  bool Peek(PlayerCommand::Kind* kind) const;
+  bool Pop(PlayerCommand* command);
+  void Drain();
+
+  static bool IsCoalesced(PlayerCommand::Kind kind) {
+    return kind == PlayerCommand::kBounds
+      || kind == PlayerCommand::kPlaybackRate
+      || kind == PlayerCommand::kVolume;
+  }
+
+  Cell Cells[kCapacity];
+  SbAtomic32 EnqueuePosition;
+  // consumer only
+  uint32_t DequeuePosition;
+  // set while a wakeup is pending, so a burst costs one eventfd write
+  SbAtomic32 Signalled;
+  const int EventFd;
+  GSource* Source;
+  Handler CommandHandler;
+  void* HandlerContext;
+  uint64_t Coalesced;
+
+  CommandQueue(const CommandQueue&) = delete;
+  CommandQueue& operator=(const CommandQueue&) = delete;
+};
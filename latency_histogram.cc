@@ -0,0 +1,96 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/latency_histogram.h"
+
+#include <sstream>
+
+namespace {
+
+// bucket limits in milliseconds, the overflow bucket has none
+const int kBucketLimitsMs[LatencyHistogram::kBucketCount - 1] = {
+  10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000
+};
+
+} // anonymous namespace
+
+LatencyHistogram::LatencyHistogram(const char* name)
+  : Name(name),
+  Values()
+{
+}
+
+// static
+SbTime LatencyHistogram::GetBucketLimit(int index)
+{
+  if (index < 0 || index >= kBucketCount - 1) {
+    return kSbTimeMax;
+  }
+  return kBucketLimitsMs[index] * kSbTimeMillisecond;
+}
+
+void LatencyHistogram::Record(SbTime latency)
+{
+  if (latency < 0) {
+    latency = 0;
+  }
+  int bucket = 0;
+  while (latency > GetBucketLimit(bucket)) {
+    ++bucket;
+  }
+  starboard::ScopedLock lock(Mutex);
+  ++Values.Buckets[bucket];
+  ++Values.Count;
+  Values.Sum += latency;
+  if (latency > Values.Max) {
+    Values.Max = latency;
+  }
+}
+
+LatencyHistogram::Data LatencyHistogram::Get() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return Values;
+}
+
+std::string LatencyHistogram::ToString() const
+{
+  const Data data = Get();
+  std::ostringstream out;
+  out << Name << " count " << data.Count;
+  if (data.Count) {
+    out << " mean " << (data.Sum / static_cast<SbTime>(data.Count)
+                        / kSbTimeMillisecond)
+      << "ms max " << (data.Max / kSbTimeMillisecond) << "ms |";
+  }
+  for (int i = 0; i < kBucketCount; ++i) {
+    if (!data.Buckets[i]) {
+      continue;
+    }
+    if (i < kBucketCount - 1) {
+      out << " <=" << (GetBucketLimit(i) / kSbTimeMillisecond) << "ms:";
+    }
+    else {
+      out << " >" << (GetBucketLimit(i - 1) / kSbTimeMillisecond) << "ms:";
+    }
+    out << data.Buckets[i];
+  }
+  return out.str();
+}
@@ -0,0 +1,66 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/common/mutex.h"
+#include "starboard/time.h"
+
+#include <cstdint>
+#include <string>
+
+// Latency distribution in fixed buckets (10 ms up to 10 s, then overflow),
+// cheap enough to record every transition and to read back at any time.
+class LatencyHistogram
+{
+public:
+  static const int kBucketCount = 11;
+
+  struct Data
+  {
+    // Buckets[i] counts latencies up to GetBucketLimit(i), the last one
+    // everything above
+    uint64_t Buckets[kBucketCount];
+    uint64_t Count;
+    SbTime Sum;
+    SbTime Max;
+  };
+
+  explicit LatencyHistogram(const char* name);
+
+  void Record(SbTime latency);
+  Data Get() const;
+  const char* GetName() const {
+    return Name;
+  }
+  // one line: name, count, mean, max and the non empty buckets
+  std::string ToString() const;
+
+  // upper bound of bucket |index|, kSbTimeMax for the last one
+  static SbTime GetBucketLimit(int index);
+
+private:
+  const char* const Name;
+  mutable starboard::Mutex Mutex;
+  Data Values;
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+};
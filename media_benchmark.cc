@@ -0,0 +1,773 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// End to end benchmark of the players, created through the Starboard API
+// and fed with synthetic H.264 and AAC streams, headless by default.
+// Prints one JSON object to stdout.
+//
+//   media_benchmark [--streams=1] [--seconds=10] [--video_kbps=4000]
+//                   [--audio_kbps=128] [--fps=30] [--gop=60]
+//                   [--scenario=all|play|seek|rate|eos]
+//                   [--pipeline=built|playbin] [--playbin_baseline_ms=0]
+//                   [--media_sink_profile=fakesink,sync]
+//
+// The time to presenting the built pipelines save over playbin: run with
+// --pipeline=playbin, then pass its mean_time_to_presenting_ms as
+// --playbin_baseline_ms to a run with the built pipelines.
+
+#include "third_party/starboard/raspi/wayland/media_preload.h"
+
+#include "starboard/common/mutex.h"
+#include "starboard/common/semaphore.h"
+#include "starboard/media.h"
+#include "starboard/player.h"
+#include "starboard/shared/starboard/command_line.h"
+#include "starboard/thread.h"
+#include "starboard/time.h"
+
+#include <sys/resource.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const int kAudioSampleRate = 48000;
+const int kAacFrameSamples = 1024;
+// 16x16, one macroblock
+const int kFrameSize = 16;
+const SbTime kStateTimeout = 10 * kSbTimeSecond;
+const int kSeeks = 3;
+
+typedef std::vector<uint8_t> Bytes;
+
+// most significant bit first, as both bitstreams want it
+class BitWriter
+{
+public:
+  BitWriter() : Data(), Free(0) {}
+
+  void Bits(uint32_t value, int count) {
+    while (count > 0) {
+      if (!Free) {
+        Data.push_back(0);
+        Free = 8;
+      }
+      const int now = count < Free ? count : Free;
+      const uint32_t part = (value >> (count - now)) & ((1u << now) - 1);
+      Data.back() |= static_cast<uint8_t>(part << (Free - now));
+      Free -= now;
+      count -= now;
+    }
+  }
+  // exp-Golomb
+  void Ue(uint32_t value) {
+    const uint32_t coded = value + 1;
+    int length = 0;
+    while ((coded >> length) > 1) {
+      ++length;
+    }
+    Bits(0, length);
+    Bits(coded, length + 1);
+  }
+  void Se(int32_t value) {
+    Ue(value > 0 ? 2 * value - 1 : -2 * value);
+  }
+  void Align() {
+    Free = 0;
+  }
+  // rbsp_trailing_bits
+  void Trailing() {
+    Bits(1, 1);
+    Align();
+  }
+  const Bytes& Get() const {
+    return Data;
+  }
+
+private:
+  Bytes Data;
+  int Free;
+};
+
+// start code, header and the payload with emulation prevention
+void AppendNal(Bytes* out, int refIdc, int type, const Bytes& rbsp)
+{
+  const uint8_t startCode[] = { 0, 0, 0, 1 };
+  out->insert(out->end(), startCode, startCode + sizeof(startCode));
+  out->push_back(static_cast<uint8_t>((refIdc << 5) | type));
+  int zeros = 0;
+  for (size_t i = 0; i < rbsp.size(); ++i) {
+    if (zeros == 2 && rbsp[i] <= 3) {
+      out->push_back(3);
+      zeros = 0;
+    }
+    out->push_back(rbsp[i]);
+    zeros = rbsp[i] ? 0 : zeros + 1;
+  }
+}
+
+// Baseline H.264, 16x16: IDR frames of one I_PCM macroblock, P frames
+// skipping it, each padded with filler data to the bitrate. Decodes
+// cheaply and correctly, so the ingest path dominates.
+class H264Stream
+{
+public:
+  H264Stream(int fps, int gop, int kbps)
+    : Fps(fps),
+    Gop(gop)
+  {
+    const size_t frameBytes = static_cast<size_t>(kbps) * 1000 / 8 / fps;
+    // two GOPs, consecutive IDRs need different idr_pic_id
+    for (int i = 0; i < 2 * gop; ++i) {
+      Bytes frame;
+      if (i % gop == 0) {
+        AppendNal(&frame, 3, 7, MakeSps());
+        AppendNal(&frame, 3, 8, MakePps());
+        AppendNal(&frame, 3, 5, MakeIdrSlice(i / gop));
+      }
+      else {
+        AppendNal(&frame, 2, 1, MakeSkippedSlice(i % gop));
+      }
+      // start code, header and trailing byte of the filler unit
+      if (frame.size() + 6 < frameBytes) {
+        Bytes filler(frameBytes - frame.size() - 6, 0xff);
+        filler.push_back(0x80);
+        AppendNal(&frame, 0, 12, filler);
+      }
+      Frames.push_back(frame);
+    }
+  }
+
+  const Bytes& GetFrame(int index) const {
+    return Frames[index % Frames.size()];
+  }
+  bool IsKeyFrame(int index) const {
+    return index % Gop == 0;
+  }
+  SbTime GetPts(int index) const {
+    return static_cast<SbTime>(index) * kSbTimeSecond / Fps;
+  }
+  // the key frame at or before |position|
+  int GetKeyFrame(SbTime position) const {
+    const int index = static_cast<int>(position * Fps / kSbTimeSecond);
+    return index - index % Gop;
+  }
+
+private:
+  static Bytes MakeSps() {
+    BitWriter b;
+    b.Bits(66, 8);    // profile_idc baseline
+    b.Bits(0xc0, 8);  // constraint_set0 and 1
+    b.Bits(30, 8);    // level_idc
+    b.Ue(0);          // seq_parameter_set_id
+    b.Ue(0);          // log2_max_frame_num_minus4
+    b.Ue(2);          // pic_order_cnt_type
+    b.Ue(1);          // max_num_ref_frames
+    b.Bits(0, 1);     // gaps_in_frame_num_value_allowed_flag
+    b.Ue(0);          // pic_width_in_mbs_minus1
+    b.Ue(0);          // pic_height_in_map_units_minus1
+    b.Bits(1, 1);     // frame_mbs_only_flag
+    b.Bits(1, 1);     // direct_8x8_inference_flag
+    b.Bits(0, 1);     // frame_cropping_flag
+    b.Bits(0, 1);     // vui_parameters_present_flag
+    b.Trailing();
+    return b.Get();
+  }
+  static Bytes MakePps() {
+    BitWriter b;
+    b.Ue(0);          // pic_parameter_set_id
+    b.Ue(0);          // seq_parameter_set_id
+    b.Bits(0, 1);     // entropy_coding_mode_flag, CAVLC
+    b.Bits(0, 1);     // bottom_field_pic_order_in_frame_present_flag
+    b.Ue(0);          // num_slice_groups_minus1
+    b.Ue(0);          // num_ref_idx_l0_default_active_minus1
+    b.Ue(0);          // num_ref_idx_l1_default_active_minus1
+    b.Bits(0, 1);     // weighted_pred_flag
+    b.Bits(0, 2);     // weighted_bipred_idc
+    b.Se(0);          // pic_init_qp_minus26
+    b.Se(0);          // pic_init_qs_minus26
+    b.Se(0);          // chroma_qp_index_offset
+    b.Bits(0, 1);     // deblocking_filter_control_present_flag
+    b.Bits(0, 1);     // constrained_intra_pred_flag
+    b.Bits(0, 1);     // redundant_pic_cnt_present_flag
+    b.Trailing();
+    return b.Get();
+  }
+  static Bytes MakeIdrSlice(int idrPicId) {
+    BitWriter b;
+    b.Ue(0);          // first_mb_in_slice
+    b.Ue(7);          // slice_type I
+    b.Ue(0);          // pic_parameter_set_id
+    b.Bits(0, 4);     // frame_num
+    b.Ue(idrPicId);   // idr_pic_id
+    b.Bits(0, 1);     // no_output_of_prior_pics_flag
+    b.Bits(0, 1);     // long_term_reference_flag
+    b.Se(0);          // slice_qp_delta
+    b.Ue(25);         // mb_type I_PCM
+    b.Align();        // pcm_alignment_zero_bit
+    // mid grey luma and chroma samples
+    for (int i = 0; i < kFrameSize * kFrameSize * 3 / 2; ++i) {
+      b.Bits(0x80, 8);
+    }
+    b.Trailing();
+    return b.Get();
+  }
+  static Bytes MakeSkippedSlice(int frameNum) {
+    BitWriter b;
+    b.Ue(0);                // first_mb_in_slice
+    b.Ue(5);                // slice_type P
+    b.Ue(0);                // pic_parameter_set_id
+    b.Bits(frameNum & 15, 4);  // frame_num
+    b.Bits(0, 1);           // num_ref_idx_active_override_flag
+    b.Bits(0, 1);           // ref_pic_list_modification_flag_l0
+    b.Bits(0, 1);           // adaptive_ref_pic_marking_mode_flag
+    b.Se(0);                // slice_qp_delta
+    b.Ue(1);                // mb_skip_run, the whole frame
+    b.Trailing();
+    return b.Get();
+  }
+
+  const int Fps;
+  const int Gop;
+  std::vector<Bytes> Frames;
+};
+
+// AAC-LC, mono, 48 kHz: a silent single channel element per frame, padded
+// with fill elements to the bitrate
+class AacStream
+{
+public:
+  explicit AacStream(int kbps) {
+    const size_t frameBytes = static_cast<size_t>(kbps) * 1000 / 8
+      * kAacFrameSamples / kAudioSampleRate;
+    BitWriter b;
+    b.Bits(0, 3);     // id_syn_ele SCE
+    b.Bits(0, 4);     // element_instance_tag
+    b.Bits(100, 8);   // global_gain
+    b.Bits(0, 1);     // ics_reserved_bit
+    b.Bits(0, 2);     // window_sequence ONLY_LONG_SEQUENCE
+    b.Bits(0, 1);     // window_shape
+    b.Bits(0, 6);     // max_sfb, no spectral data at all
+    b.Bits(0, 1);     // predictor_data_present
+    b.Bits(0, 3);     // pulse, tns and gain control data present
+    // 4 bytes so far, each fill element adds 1 or 2 bytes of overhead
+    size_t size = 4;
+    while (size + 3 < frameBytes) {
+      size_t count = frameBytes - size - 2;
+      if (count > 269) {
+        count = 269;
+      }
+      b.Bits(6, 3);   // id_syn_ele FIL
+      if (count >= 15) {
+        b.Bits(15, 4);
+        b.Bits(static_cast<uint32_t>(count - 14), 8);  // esc_count
+      }
+      else {
+        b.Bits(static_cast<uint32_t>(count), 4);
+      }
+      b.Bits(0, 4);   // extension_type EXT_FILL
+      b.Bits(0, 4);   // fill_nibble
+      for (size_t i = 1; i < count; ++i) {
+        b.Bits(0xa5, 8);  // fill_byte
+      }
+      size += count + (count >= 15 ? 2 : 1);
+    }
+    b.Bits(7, 3);     // id_syn_ele END
+    b.Align();
+    Frame = b.Get();
+  }
+
+  const Bytes& GetFrame() const {
+    return Frame;
+  }
+  SbTime GetPts(int index) const {
+    return static_cast<SbTime>(index) * kAacFrameSamples * kSbTimeSecond
+      / kAudioSampleRate;
+  }
+  int GetFrameAt(SbTime position) const {
+    return static_cast<int>(position * kAudioSampleRate
+                            / (kAacFrameSamples * kSbTimeSecond));
+  }
+  // AudioSpecificConfig: AAC-LC, 48 kHz, 1 channel
+  static const uint8_t* GetConfig() {
+    static const uint8_t config[] = { 0x11, 0x88 };
+    return config;
+  }
+
+private:
+  Bytes Frame;
+};
+
+struct Options
+{
+  int Streams;
+  SbTime Duration;
+  int VideoKbps;
+  int AudioKbps;
+  int Fps;
+  int Gop;
+  std::string Scenario;
+  std::string Pipeline;
+  // mean time to presenting of playbin, 0 when not known
+  int PlaybinBaselineMs;
+};
+
+int GetSwitch(const starboard::shared::starboard::CommandLine& commandLine,
+              const char* name, int fallback)
+{
+  if (!commandLine.HasSwitch(name)) {
+    return fallback;
+  }
+  const int value = atoi(commandLine.GetSwitchValue(name).c_str());
+  return value > 0 ? value : fallback;
+}
+
+Options ParseOptions(int argc, char** argv)
+{
+  starboard::shared::starboard::CommandLine commandLine(argc, argv);
+  Options options;
+  options.Streams = GetSwitch(commandLine, "streams", 1);
+  options.Duration = GetSwitch(commandLine, "seconds", 10) * kSbTimeSecond;
+  options.VideoKbps = GetSwitch(commandLine, "video_kbps", 4000);
+  options.AudioKbps = GetSwitch(commandLine, "audio_kbps", 128);
+  options.Fps = GetSwitch(commandLine, "fps", 30);
+  options.Gop = GetSwitch(commandLine, "gop", 60);
+  options.Scenario = commandLine.HasSwitch("scenario")
+    ? commandLine.GetSwitchValue("scenario") : "all";
+  options.Pipeline = commandLine.HasSwitch("pipeline")
+    ? commandLine.GetSwitchValue("pipeline") : "built";
+  options.PlaybinBaselineMs = GetSwitch(commandLine, "playbin_baseline_ms", 0);
+  return options;
+}
+
+struct Result
+{
+  bool Created;
+  int Errors;
+  uint64_t BytesWritten;
+  uint64_t SamplesWritten;
+  SbTime TimeToPresenting;
+  std::vector<SbTime> SeekLatencies;
+  // position advance per wall clock time at playback rate 2
+  double ObservedRate;
+  SbTime EndOfStreamLatency;
+  SbTime DestroyTime;
+};
+
+// one player and the scenarios run on it, on a thread of its own
+class BenchmarkPlayer
+{
+public:
+  BenchmarkPlayer(const Options& options, const H264Stream& video,
+                  const AacStream& audio)
+    : Config(options),
+    Video(video),
+    Audio(audio),
+    Player(kSbPlayerInvalid),
+    Ticket(0),
+    State(kSbPlayerStateInitialized),
+    StateTicket(0),
+    NeedsVideo(false),
+    NeedsAudio(false),
+    VideoIndex(0),
+    AudioIndex(0),
+    EndPts(-1),
+    VideoEnded(false),
+    AudioEnded(false),
+    Outcome()
+  {
+  }
+
+  static void* Thread(void* data) {
+    reinterpret_cast<BenchmarkPlayer*>(data)->Run();
+    return nullptr;
+  }
+
+  const Result& GetResult() const {
+    return Outcome;
+  }
+
+private:
+  bool Wants(const char* scenario) const {
+    return Config.Scenario == "all" || Config.Scenario == scenario;
+  }
+
+  void Run() {
+    const SbTime created = SbTimeGetMonotonicNow();
+    if (!Create()) {
+      return;
+    }
+    Outcome.Created = true;
+    Seek(0);
+    SbPlayerSetPlaybackRate(Player, 1.0);
+    if (WaitForState(kSbPlayerStatePresenting)) {
+      Outcome.TimeToPresenting = SbTimeGetMonotonicNow() - created;
+    }
+
+    if (Wants("play") || Wants("seek")) {
+      Pump(Config.Duration);
+    }
+    if (Wants("seek")) {
+      for (int i = 1; i <= kSeeks; ++i) {
+        const SbTime target = Config.Duration * i / (kSeeks + 1);
+        const SbTime start = SbTimeGetMonotonicNow();
+        Seek(target);
+        if (WaitForState(kSbPlayerStatePresenting)) {
+          Outcome.SeekLatencies.push_back(SbTimeGetMonotonicNow() - start);
+        }
+        Pump(kSbTimeSecond);
+      }
+    }
+    if (Wants("rate")) {
+      SbPlayerSetPlaybackRate(Player, 2.0);
+      Pump(kSbTimeSecond / 2);
+      const SbTime before = GetPosition();
+      const SbTime start = SbTimeGetMonotonicNow();
+      Pump(2 * kSbTimeSecond);
+      const SbTime elapsed = SbTimeGetMonotonicNow() - start;
+      Outcome.ObservedRate = static_cast<double>(GetPosition() - before)
+        / elapsed;
+      SbPlayerSetPlaybackRate(Player, 1.0);
+      Pump(kSbTimeSecond / 2);
+    }
+    if (Wants("eos")) {
+      {
+        starboard::ScopedLock lock(Mutex);
+        EndPts = Video.GetPts(VideoIndex) + kSbTimeSecond;
+      }
+      const SbTime start = SbTimeGetMonotonicNow();
+      if (WaitForState(kSbPlayerStateEndOfStream)) {
+        Outcome.EndOfStreamLatency = SbTimeGetMonotonicNow() - start;
+      }
+    }
+
+    const SbTime destroying = SbTimeGetMonotonicNow();
+    SbPlayerDestroy(Player);
+    Outcome.DestroyTime = SbTimeGetMonotonicNow() - destroying;
+  }
+
+  bool Create() {
+    SbMediaAudioSampleInfo header = SbMediaAudioSampleInfo();
+    header.format_tag = 0xff;
+    header.number_of_channels = 1;
+    header.samples_per_second = kAudioSampleRate;
+    header.average_bytes_per_second = Config.AudioKbps * 1000 / 8;
+    header.bits_per_sample = 16;
+    header.audio_specific_config_size = 2;
+    header.audio_specific_config = AacStream::GetConfig();
+    Player = SbPlayerCreate(kSbWindowInvalid, kSbMediaVideoCodecH264,
+                            kSbMediaAudioCodecAac, kSbDrmSystemInvalid,
+                            &header,
+#if SB_API_VERSION >= 11
+                            "",
+#endif
+                            &BenchmarkPlayer::Deallocate,
+                            &BenchmarkPlayer::DecoderStatus,
+                            &BenchmarkPlayer::PlayerStatus,
+                            &BenchmarkPlayer::PlayerError, this,
+                            kSbPlayerOutputModePunchOut, nullptr);
+    return SbPlayerIsValid(Player);
+  }
+
+  void Seek(SbTime position) {
+    int ticket;
+    {
+      starboard::ScopedLock lock(Mutex);
+      ticket = ++Ticket;
+      VideoIndex = Video.GetKeyFrame(position);
+      AudioIndex = Audio.GetFrameAt(Video.GetPts(VideoIndex));
+      NeedsVideo = false;
+      NeedsAudio = false;
+      VideoEnded = false;
+      AudioEnded = false;
+    }
+    SbPlayerSeek(Player, Video.GetPts(VideoIndex), ticket);
+  }
+
+  SbTime GetPosition() const {
+    SbPlayerInfo2 info;
+    SbPlayerGetInfo(Player, &info);
+    return info.current_media_timestamp;
+  }
+
+  bool WaitForState(SbPlayerState state) {
+    const SbTime deadline = SbTimeGetMonotonicNow() + kStateTimeout;
+    while (SbTimeGetMonotonicNow() < deadline) {
+      {
+        starboard::ScopedLock lock(Mutex);
+        if (State == state && StateTicket == Ticket) {
+          return true;
+        }
+      }
+      Step();
+    }
+    starboard::ScopedLock lock(Mutex);
+    ++Outcome.Errors;
+    return false;
+  }
+
+  void Pump(SbTime duration) {
+    const SbTime deadline = SbTimeGetMonotonicNow() + duration;
+    while (SbTimeGetMonotonicNow() < deadline) {
+      Step();
+    }
+  }
+
+  // writes the samples asked for, one per NeedsData as Cobalt does
+  void Step() {
+    Wakeup.TakeWait(10 * kSbTimeMillisecond);
+    bool video;
+    bool audio;
+    SbTime endPts;
+    {
+      starboard::ScopedLock lock(Mutex);
+      video = NeedsVideo;
+      audio = NeedsAudio;
+      NeedsVideo = false;
+      NeedsAudio = false;
+      endPts = EndPts;
+    }
+    if (video && !VideoEnded) {
+      if (endPts >= 0 && Video.GetPts(VideoIndex) >= endPts) {
+        SbPlayerWriteEndOfStream(Player, kSbMediaTypeVideo);
+        VideoEnded = true;
+      }
+      else {
+        SbMediaVideoSampleInfo info = SbMediaVideoSampleInfo();
+        info.is_key_frame = Video.IsKeyFrame(VideoIndex);
+        info.frame_width = kFrameSize;
+        info.frame_height = kFrameSize;
+        Write(kSbMediaTypeVideo, Video.GetFrame(VideoIndex),
+              Video.GetPts(VideoIndex), &info);
+        ++VideoIndex;
+      }
+    }
+    if (audio && !AudioEnded) {
+      if (endPts >= 0 && Audio.GetPts(AudioIndex) >= endPts) {
+        SbPlayerWriteEndOfStream(Player, kSbMediaTypeAudio);
+        AudioEnded = true;
+      }
+      else {
+        Write(kSbMediaTypeAudio, Audio.GetFrame(), Audio.GetPts(AudioIndex),
+              nullptr);
+        ++AudioIndex;
+      }
+    }
+  }
+
+  void Write(SbMediaType type, const Bytes& sample, SbTime pts,
+             const SbMediaVideoSampleInfo* info) {
+    const void* buffers[] = { sample.data() };
+    const int sizes[] = { static_cast<int>(sample.size()) };
+    SbPlayerWriteSample(Player, type, buffers, sizes, 1, pts, info, nullptr);
+    Outcome.BytesWritten += sample.size();
+    ++Outcome.SamplesWritten;
+  }
+
+  static void Deallocate(SbPlayer, void*, const void*) {
+    // the samples are shared and live till the end
+  }
+
+  static void DecoderStatus(SbPlayer, void* context, SbMediaType type,
+                            SbPlayerDecoderState state, int ticket) {
+    BenchmarkPlayer& p = *reinterpret_cast<BenchmarkPlayer*>(context);
+    if (state != kSbPlayerDecoderStateNeedsData) {
+      return;
+    }
+    {
+      starboard::ScopedLock lock(p.Mutex);
+      if (ticket != p.Ticket) {
+        return;
+      }
+      if (type == kSbMediaTypeVideo) {
+        p.NeedsVideo = true;
+      }
+      else {
+        p.NeedsAudio = true;
+      }
+    }
+    p.Wakeup.Put();
+  }
+
+  static void PlayerStatus(SbPlayer, void* context, SbPlayerState state,
+                           int ticket) {
+    BenchmarkPlayer& p = *reinterpret_cast<BenchmarkPlayer*>(context);
+    starboard::ScopedLock lock(p.Mutex);
+    p.State = state;
+    p.StateTicket = ticket;
+  }
+
+  static void PlayerError(SbPlayer, void* context, SbPlayerError,
+                          const char* message) {
+    BenchmarkPlayer& p = *reinterpret_cast<BenchmarkPlayer*>(context);
+    fprintf(stderr, "player error: %s\n", message ? message : "");
+    starboard::ScopedLock lock(p.Mutex);
+    ++p.Outcome.Errors;
+  }
+
+  const Options& Config;
+  const H264Stream& Video;
+  const AacStream& Audio;
+  SbPlayer Player;
+
+  // shared with the callbacks
+  starboard::Mutex Mutex;
+  starboard::Semaphore Wakeup;
+  int Ticket;
+  SbPlayerState State;
+  int StateTicket;
+  bool NeedsVideo;
+  bool NeedsAudio;
+
+  // the benchmark thread only
+  int VideoIndex;
+  int AudioIndex;
+  SbTime EndPts;
+  bool VideoEnded;
+  bool AudioEnded;
+  Result Outcome;
+
+  BenchmarkPlayer(const BenchmarkPlayer&) = delete;
+  BenchmarkPlayer& operator=(const BenchmarkPlayer&) = delete;
+};
+
+double Milliseconds(SbTime time)
+{
+  return static_cast<double>(time) / kSbTimeMillisecond;
+}
+
+SbTime GetCpuTime()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * kSbTimeSecond
+    + usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+}
+
+long GetPeakMemoryKb()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+std::string ToJson(const Options& options,
+                   const std::vector<BenchmarkPlayer*>& players,
+                   SbTime wall, SbTime cpu)
+{
+  std::ostringstream out;
+  uint64_t bytes = 0;
+  uint64_t samples = 0;
+  SbTime presenting = 0;
+  int presented = 0;
+  out << "{\n  \"scenario\": \"" << options.Scenario << "\",\n"
+    << "  \"pipeline\": \"" << options.Pipeline << "\",\n"
+    << "  \"streams\": " << options.Streams << ",\n"
+    << "  \"video_kbps\": " << options.VideoKbps << ",\n"
+    << "  \"audio_kbps\": " << options.AudioKbps << ",\n"
+    << "  \"fps\": " << options.Fps << ",\n"
+    << "  \"players\": [";
+  for (size_t i = 0; i < players.size(); ++i) {
+    const Result& result = players[i]->GetResult();
+    bytes += result.BytesWritten;
+    samples += result.SamplesWritten;
+    if (result.TimeToPresenting > 0) {
+      presenting += result.TimeToPresenting;
+      ++presented;
+    }
+    out << (i ? ",\n" : "\n") << "    {\"created\": "
+      << (result.Created ? "true" : "false")
+      << ", \"errors\": " << result.Errors
+      << ", \"bytes_written\": " << result.BytesWritten
+      << ", \"samples_written\": " << result.SamplesWritten
+      << ", \"time_to_presenting_ms\": "
+      << Milliseconds(result.TimeToPresenting)
+      << ", \"seek_latency_ms\": [";
+    for (size_t j = 0; j < result.SeekLatencies.size(); ++j) {
+      out << (j ? ", " : "") << Milliseconds(result.SeekLatencies[j]);
+    }
+    out << "], \"observed_rate_2x\": " << result.ObservedRate
+      << ", \"end_of_stream_ms\": " << Milliseconds(result.EndOfStreamLatency)
+      << ", \"destroy_ms\": " << Milliseconds(result.DestroyTime) << "}";
+  }
+  const double seconds = static_cast<double>(wall) / kSbTimeSecond;
+  const double meanPresenting
+    = presented ? Milliseconds(presenting) / presented : 0.0;
+  out << "\n  ],\n"
+    << "  \"mean_time_to_presenting_ms\": " << meanPresenting << ",\n";
+  if (options.PlaybinBaselineMs && presented) {
+    out << "  \"saved_over_playbin_ms\": "
+      << options.PlaybinBaselineMs - meanPresenting << ",\n";
+  }
+  out << "  \"wall_s\": " << seconds << ",\n"
+    << "  \"ingest_mbytes_per_s\": " << bytes / seconds / 1e6 << ",\n"
+    << "  \"ingest_samples_per_s\": " << samples / seconds << ",\n"
+    << "  \"cpu_per_stream\": "
+    << static_cast<double>(cpu) / wall / options.Streams << ",\n"
+    << "  \"peak_memory_kb\": " << GetPeakMemoryKb() << "\n}\n";
+  return out.str();
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // headless unless the profile is given
+  setenv("COBALT_MEDIA_SINK_PROFILE", "fakesink,sync", 0);
+  const Options options = ParseOptions(argc, argv);
+  // read when the pool builds the first pipelines
+  setenv("COBALT_MEDIA_PIPELINE", options.Pipeline.c_str(), 1);
+  MediaPreload::Run(argc, argv);
+  MediaPreload::Wait();
+  const H264Stream video(options.Fps, options.Gop, options.VideoKbps);
+  const AacStream audio(options.AudioKbps);
+
+  std::vector<BenchmarkPlayer*> players;
+  std::vector<SbThread> threads;
+  const SbTime cpuStart = GetCpuTime();
+  const SbTime start = SbTimeGetMonotonicNow();
+  for (int i = 0; i < options.Streams; ++i) {
+    players.push_back(new BenchmarkPlayer(options, video, audio));
+    threads.push_back(
+      SbThreadCreate(0, kSbThreadPriorityNormal, kSbThreadNoAffinity, true,
+                     "benchmark", &BenchmarkPlayer::Thread, players.back()));
+  }
+  for (size_t i = 0; i < threads.size(); ++i) {
+    SbThreadJoin(threads[i], nullptr);
+  }
+  const SbTime wall = SbTimeGetMonotonicNow() - start;
+  const SbTime cpu = GetCpuTime() - cpuStart;
+
+  printf("%s", ToJson(options, players, wall, cpu).c_str());
+  int failures = 0;
+  for (size_t i = 0; i < players.size(); ++i) {
+    const Result& result = players[i]->GetResult();
+    if (!result.Created || result.Errors) {
+      ++failures;
+    }
+    delete players[i];
+  }
+  return failures ? 1 : 0;
+}
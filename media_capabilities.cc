@@ -0,0 +1,375 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/media_capabilities.h"
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
+
+#include "starboard/file.h"
+#include "starboard/system.h"
+
+#include "base/logging.h"
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+const char kCacheFile[] = "media-capabilities.txt";
+// bumped when the probing or the file changes
+const int kCacheVersion = 1;
+
+// limits of the players, whatever the decoders claim
+const int kMaxFrameSize = 5000;
+const int kMaxFps = 60;
+
+struct VideoProbe
+{
+  SbMediaVideoCodec Codec;
+  // as written by the VideoDecoder
+  const char* Caps;
+};
+
+struct AudioProbe
+{
+  SbMediaAudioCodec Codec;
+  const char* Caps;
+};
+
+const VideoProbe kVideoProbes[] = {
+  { kSbMediaVideoCodecH264, "video/x-h264" },
+  { kSbMediaVideoCodecMpeg2, "video/x-mpeg" },
+  { kSbMediaVideoCodecVc1, "video/x-vc1" },
+  { kSbMediaVideoCodecVp8, "video/x-vp8" },
+};
+
+const AudioProbe kAudioProbes[] = {
+  { kSbMediaAudioCodecAac, "audio/mpeg, mpegversion=(int)4" },
+};
+
+uint64_t Hash(uint64_t hash, const char* text)
+{
+  // FNV-1a
+  for (; text && *text; ++text) {
+    hash ^= static_cast<unsigned char>(*text);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool IsInstalled(const char* name)
+{
+  GstElementFactory* factory = gst_element_factory_find(name);
+  if (!factory) {
+    return false;
+  }
+  gst_object_unref(factory);
+  return true;
+}
+
+// the decoder autoplugging would pick for |caps|, new reference or nullptr
+GstElementFactory* FindDecoder(GstCaps* caps)
+{
+  GList* all = gst_element_factory_list_get_elements(
+    GST_ELEMENT_FACTORY_TYPE_DECODER, GST_RANK_MARGINAL);
+  GList* accepting
+    = gst_element_factory_list_filter(all, caps, GST_PAD_SINK, FALSE);
+  accepting = g_list_sort(accepting, gst_plugin_feature_rank_compare_func);
+  GstElementFactory* best = accepting
+    ? GST_ELEMENT_FACTORY(gst_object_ref(accepting->data)) : nullptr;
+  gst_plugin_feature_list_free(accepting);
+  gst_plugin_feature_list_free(all);
+  return best;
+}
+
+// upper bound of an int or int range field, |fallback| when unbounded
+int GetMax(const GstStructure* s, const char* field, int fallback)
+{
+  const GValue* value = gst_structure_get_value(s, field);
+  if (!value) {
+    return fallback;
+  }
+  if (G_VALUE_HOLDS_INT(value)) {
+    return g_value_get_int(value);
+  }
+  if (GST_VALUE_HOLDS_INT_RANGE(value)) {
+    return gst_value_get_int_range_max(value);
+  }
+  return fallback;
+}
+
+int GetMaxFps(const GstStructure* s, int fallback)
+{
+  const GValue* value = gst_structure_get_value(s, "framerate");
+  if (!value) {
+    return fallback;
+  }
+  if (GST_VALUE_HOLDS_FRACTION_RANGE(value)) {
+    value = gst_value_get_fraction_range_max(value);
+  }
+  if (!GST_VALUE_HOLDS_FRACTION(value)
+      || gst_value_get_fraction_denominator(value) <= 0) {
+    return fallback;
+  }
+  return gst_value_get_fraction_numerator(value)
+    / gst_value_get_fraction_denominator(value);
+}
+
+// the largest limits the sink templates of |factory| give for |caps|
+void GetLimits(GstElementFactory* factory, GstCaps* caps,
+               int* width, int* height, int* fps)
+{
+  *width = 0;
+  *height = 0;
+  *fps = 0;
+  const GList* templates = gst_element_factory_get_static_pad_templates(factory);
+  for (const GList* l = templates; l; l = l->next) {
+    GstStaticPadTemplate* t = static_cast<GstStaticPadTemplate*>(l->data);
+    if (t->direction != GST_PAD_SINK) {
+      continue;
+    }
+    GstCaps* templateCaps = gst_static_caps_get(&t->static_caps);
+    GstCaps* matching = gst_caps_intersect(templateCaps, caps);
+    for (guint i = 0; i < gst_caps_get_size(matching); ++i) {
+      const GstStructure* s = gst_caps_get_structure(matching, i);
+      *width = std::max(*width, GetMax(s, "width", kMaxFrameSize));
+      *height = std::max(*height, GetMax(s, "height", kMaxFrameSize));
+      *fps = std::max(*fps, GetMaxFps(s, kMaxFps));
+    }
+    gst_caps_unref(matching);
+    gst_caps_unref(templateCaps);
+  }
+  *width = std::min(*width, kMaxFrameSize);
+  *height = std::min(*height, kMaxFrameSize);
+  *fps = std::min(*fps, kMaxFps);
+}
+
+std::string GetCachePath()
+{
+  char directory[SB_FILE_MAX_PATH];
+  if (!SbSystemGetPath(kSbSystemPathCacheDirectory, directory,
+                       sizeof(directory))) {
+    return std::string();
+  }
+  return std::string(directory) + SB_FILE_SEP_STRING + kCacheFile;
+}
+
+} // anonymous namespace
+
+// static
+const MediaCapabilities& MediaCapabilities::Get()
+{
+  static const MediaCapabilities* capabilities = new MediaCapabilities();
+  return *capabilities;
+}
+
+MediaCapabilities::MediaCapabilities()
+  : RegistryHash(GetRegistryHash()),
+  Cached(false),
+  Video(),
+  Audio()
+{
+  const std::string path = GetCachePath();
+  if (!path.empty() && Load(path)) {
+    Cached = true;
+  }
+  else {
+    Probe();
+    if (!path.empty()) {
+      Store(path);
+    }
+  }
+  SB_LOG(INFO) << "media capabilities " << (Cached ? "cached" : "probed")
+    << ":" << ToString();
+}
+
+bool MediaCapabilities::IsVideoSupported(SbMediaVideoCodec codec, int width,
+                                         int height, int fps) const
+{
+  const int index = static_cast<int>(codec);
+  if (index < 0 || index >= kMaxCodecs) {
+    return false;
+  }
+  const VideoLimits& limits = Video[index];
+  return limits.Supported
+    && width >= 0 && width <= limits.MaxWidth
+    && height >= 0 && height <= limits.MaxHeight
+    && fps >= 0 && fps <= limits.MaxFps;
+}
+
+bool MediaCapabilities::IsAudioSupported(SbMediaAudioCodec codec) const
+{
+  const int index = static_cast<int>(codec);
+  return index >= 0 && index < kMaxCodecs && Audio[index];
+}
+
+std::string MediaCapabilities::ToString() const
+{
+  std::ostringstream out;
+  for (const VideoProbe& probe : kVideoProbes) {
+    const VideoLimits& limits = Video[probe.Codec];
+    if (limits.Supported) {
+      out << ' ' << probe.Caps << ' ' << limits.MaxWidth << 'x'
+        << limits.MaxHeight << '@' << limits.MaxFps;
+    }
+  }
+  for (const AudioProbe& probe : kAudioProbes) {
+    if (Audio[probe.Codec]) {
+      out << ' ' << probe.Caps;
+    }
+  }
+  return out.str();
+}
+
+void MediaCapabilities::Probe()
+{
+  const SinkProfile& profile = SinkProfile::Get();
+  const bool videoSink = IsInstalled(profile.GetVideoSinkName());
+  const bool audioSink = IsInstalled(profile.GetAudioSinkName());
+  for (const VideoProbe& probe : kVideoProbes) {
+    if (videoSink && profile.IsPassthrough()) {
+      // nothing is decoded, the sink takes the stream as written
+      VideoLimits& limits = Video[probe.Codec];
+      limits.MaxWidth = kMaxFrameSize;
+      limits.MaxHeight = kMaxFrameSize;
+      limits.MaxFps = kMaxFps;
+      limits.Supported = true;
+      continue;
+    }
+    GstCaps* caps = gst_caps_from_string(probe.Caps);
+    GstElementFactory* decoder = videoSink ? FindDecoder(caps) : nullptr;
+    if (decoder) {
+      VideoLimits& limits = Video[probe.Codec];
+      GetLimits(decoder, caps, &limits.MaxWidth, &limits.MaxHeight,
+                &limits.MaxFps);
+      limits.Supported = true;
+      gst_object_unref(decoder);
+    }
+    gst_caps_unref(caps);
+  }
+  for (const AudioProbe& probe : kAudioProbes) {
+    if (audioSink && profile.IsPassthrough()) {
+      Audio[probe.Codec] = true;
+      continue;
+    }
+    GstCaps* caps = gst_caps_from_string(probe.Caps);
+    GstElementFactory* decoder = audioSink ? FindDecoder(caps) : nullptr;
+    if (decoder) {
+      Audio[probe.Codec] = true;
+      gst_object_unref(decoder);
+    }
+    gst_caps_unref(caps);
+  }
+}
+
+bool MediaCapabilities::Load(const std::string& path)
+{
+  std::ifstream in(path.c_str());
+  std::string magic;
+  int version = 0;
+  uint64_t hash = 0;
+  if (!(in >> magic >> version >> std::hex >> hash >> std::dec)
+      || magic != "capabilities" || version != kCacheVersion
+      || hash != RegistryHash) {
+    return false;
+  }
+  std::string type;
+  int codec;
+  while (in >> type >> codec) {
+    if (codec < 0 || codec >= kMaxCodecs) {
+      return false;
+    }
+    if (type == "video") {
+      VideoLimits& limits = Video[codec];
+      if (!(in >> limits.MaxWidth >> limits.MaxHeight >> limits.MaxFps)) {
+        return false;
+      }
+      limits.Supported = true;
+    }
+    else if (type == "audio") {
+      Audio[codec] = true;
+    }
+    else {
+      return false;
+    }
+  }
+  return in.eof();
+}
+
+void MediaCapabilities::Store(const std::string& path) const
+{
+  // written aside and renamed, a reader never sees half a file
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary.c_str(), std::ios::trunc);
+    out << "capabilities " << kCacheVersion << ' ' << std::hex
+      << RegistryHash << std::dec << '\n';
+    for (int i = 0; i < kMaxCodecs; ++i) {
+      const VideoLimits& limits = Video[i];
+      if (limits.Supported) {
+        out << "video " << i << ' ' << limits.MaxWidth << ' '
+          << limits.MaxHeight << ' ' << limits.MaxFps << '\n';
+      }
+      if (Audio[i]) {
+        out << "audio " << i << '\n';
+      }
+    }
+    if (!out) {
+      SB_DLOG(WARNING) << "failed to write " << temporary;
+      return;
+    }
+  }
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    SB_DLOG(WARNING) << "failed to store " << path;
+    remove(temporary.c_str());
+  }
+}
+
+// static
+uint64_t MediaCapabilities::GetRegistryHash()
+{
+  uint64_t hash = 14695981039346656037ull;
+  hash = Hash(hash, SinkProfile::Get().ToString().c_str());
+  gchar* version = gst_version_string();
+  hash = Hash(hash, version);
+  g_free(version);
+  // the decoders and sinks, with the ranks the profile left them
+  GList* factories = gst_element_factory_list_get_elements(
+    GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_SINK,
+    GST_RANK_NONE);
+  factories = g_list_sort(factories, gst_plugin_feature_rank_compare_func);
+  for (GList* l = factories; l; l = l->next) {
+    GstPluginFeature* feature = GST_PLUGIN_FEATURE(l->data);
+    hash = Hash(hash, gst_plugin_feature_get_name(feature));
+    hash = Hash(hash, std::to_string(gst_plugin_feature_get_rank(feature))
+                        .c_str());
+    GstPlugin* plugin = gst_plugin_feature_get_plugin(feature);
+    if (plugin) {
+      hash = Hash(hash, gst_plugin_get_version(plugin));
+      gst_object_unref(plugin);
+    }
+  }
+  gst_plugin_feature_list_free(factories);
+  return hash;
+}
@@ -0,0 +1,74 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/media.h"
+
+#include <cstdint>
+#include <string>
+
+// What the installed decoders and sinks can play, for SbMediaIsVideoSupported
+// and SbMediaIsAudioSupported. Probed once from the GStreamer registry: per
+// codec the best ranked decoder, the one autoplugging and the
+// PipelineBuilder pick, and the size and frame rate limits of its sink pad
+// template. The result is stored next to the registry cache, keyed by a
+// hash of the registry and the SinkProfile, so later starts only read it
+// back. Lookups index the codec tables directly.
+class MediaCapabilities
+{
+public:
+  // built on first use, after gst_init and SinkProfile::Configure
+  static const MediaCapabilities& Get();
+
+  // 0 for a size or rate not known yet
+  bool IsVideoSupported(SbMediaVideoCodec codec, int width, int height,
+                        int fps) const;
+  bool IsAudioSupported(SbMediaAudioCodec codec) const;
+
+  // from the cache or probed
+  bool IsCached() const {
+    return Cached;
+  }
+  std::string ToString() const;
+
+private:
+  static const int kMaxCodecs = 16;
+
+  struct VideoLimits
+  {
+    bool Supported;
+    int MaxWidth;
+    int MaxHeight;
+    int MaxFps;
+  };
+
+  MediaCapabilities();
+  void Probe();
+  bool Load(const std::string& path);
+  void Store(const std::string& path) const;
+  // of the decoders and sinks in the registry, and the profile
+  static uint64_t GetRegistryHash();
+
+  uint64_t RegistryHash;
+  bool Cached;
+  VideoLimits Video[kMaxCodecs];
+  bool Audio[kMaxCodecs];
+};
@@ -0,0 +1,460 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/media_preload.h"
+#include "third_party/starboard/raspi/wayland/cobalt_source.h"
+#include "third_party/starboard/raspi/wayland/media_capabilities.h"
+#include "third_party/starboard/raspi/wayland/media_reactor.h"
+#include "third_party/starboard/raspi/wayland/pipeline_builder.h"
+#include "third_party/starboard/raspi/wayland/pipeline_pool.h"
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
+
+#include "starboard/atomic.h"
+#include "starboard/common/semaphore.h"
+#include "starboard/file.h"
+#include "starboard/media.h"
+#include "starboard/system.h"
+#include "starboard/time.h"
+
+#include "base/logging.h"
+
+#include <gst/gst.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char kRegistryFile[] = "gstreamer-registry.bin";
+
+// elements every pipeline is made of, playbin internals included
+const char* const kFactories[] = {
+  "playbin",
+  "uridecodebin",
+  "decodebin",
+  "playsink",
+  "streamsynchronizer",
+  "input-selector",
+  "multiqueue",
+  "queue",
+  "typefind",
+};
+
+// caps of the streams written by the decoders, see CreateCaps
+const char* const kStreamCaps[] = {
+  "video/x-h264, stream-format=(string)byte-stream",
+  "video/x-mpeg",
+  "video/x-vc1",
+  "video/x-vp8",
+  "audio/mpeg, mpegversion=(int)4, framed=(boolean)true, "
+    "stream-format=(string)raw",
+};
+
+// never released, so neither plugins nor classes are ever unloaded
+std::vector<GstPluginFeature*> PinnedFeatures;
+std::vector<GstCaps*> PinnedCaps;
+
+// the registry cache and its key, empty when GST_REGISTRY is set outside
+std::string RegistryPath;
+// the cache was used without scanning the plugin directories
+bool RegistryTrusted = false;
+// a plugin listed in the registry failed to load, the cache is stale
+bool LoadFailed = false;
+
+// set once the preload is done, Loaded is put back by every waiter
+SbAtomic32 Done = 0;
+starboard::Semaphore Loaded;
+
+class StageTimer
+{
+public:
+  StageTimer() : Start(SbTimeGetMonotonicNow()), Last(Start) {}
+
+  void Done(const char* stage) {
+    const SbTime now = SbTimeGetMonotonicNow();
+    Report << ' ' << stage << ' ' << (now - Last) / kSbTimeMillisecond << "ms";
+    Last = now;
+  }
+  std::string ToString() const {
+    return Report.str() + " total "
+      + std::to_string((Last - Start) / kSbTimeMillisecond) + "ms";
+  }
+
+private:
+  const SbTime Start;
+  SbTime Last;
+  std::ostringstream Report;
+};
+
+const char kKeyDirectory[] = "dir ";
+
+// the registry is trusted while this stays the same: the GStreamer
+// version, the plugin paths given and the modification time of every
+// directory plugins came from. installing, removing or replacing a plugin
+// file changes the time of its directory
+std::string GetRegistryKey(const std::vector<std::string>& directories)
+{
+  guint major, minor, micro, nano;
+  gst_version(&major, &minor, &micro, &nano);
+  std::ostringstream key;
+  key << "gst " << major << '.' << minor << '.' << micro << '.' << nano
+    << '\n';
+  const char* const variables[] = {
+    "GST_PLUGIN_PATH_1_0",
+    "GST_PLUGIN_PATH",
+    "GST_PLUGIN_SYSTEM_PATH_1_0",
+    "GST_PLUGIN_SYSTEM_PATH",
+  };
+  for (const char* variable : variables) {
+    const char* value = getenv(variable);
+    key << variable << ' ' << (value ? value : "") << '\n';
+  }
+  for (const std::string& directory : directories) {
+    SbFileInfo info;
+    const SbTime modified = SbFileGetPathInfo(directory.c_str(), &info)
+      ? info.last_modified : 0;
+    key << kKeyDirectory << directory << ' ' << modified << '\n';
+  }
+  return key.str();
+}
+
+std::string GetKeyPath()
+{
+  return RegistryPath + ".key";
+}
+
+std::string LoadRegistryKey()
+{
+  std::ifstream in(GetKeyPath().c_str());
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+// the directories a stored key was made of
+std::vector<std::string> GetKeyDirectories(const std::string& key)
+{
+  std::vector<std::string> directories;
+  std::istringstream in(key);
+  std::string line;
+  const size_t prefix = sizeof(kKeyDirectory) - 1;
+  while (std::getline(in, line)) {
+    const size_t time = line.rfind(' ');
+    if (line.compare(0, prefix, kKeyDirectory) == 0
+        && time != std::string::npos && time > prefix) {
+      directories.push_back(line.substr(prefix, time - prefix));
+    }
+  }
+  return directories;
+}
+
+// after gst_init, keyed by the directories of the plugins found
+void StoreRegistryKey()
+{
+  if (RegistryPath.empty()) {
+    return;
+  }
+  std::set<std::string> directories;
+  GList* plugins = gst_registry_get_plugin_list(gst_registry_get());
+  for (GList* i = plugins; i; i = i->next) {
+    const gchar* file = gst_plugin_get_filename(GST_PLUGIN(i->data));
+    if (file) {
+      gchar* directory = g_path_get_dirname(file);
+      directories.insert(directory);
+      g_free(directory);
+    }
+  }
+  gst_plugin_list_free(plugins);
+  const std::string key = GetRegistryKey(
+    std::vector<std::string>(directories.begin(), directories.end()));
+  if (key == LoadRegistryKey()) {
+    return;
+  }
+  // written aside and renamed, a reader never sees half a file
+  const std::string path = GetKeyPath();
+  const std::string temporary = path + ".tmp";
+  {
+    std::ofstream out(temporary.c_str(), std::ios::trunc);
+    out << key;
+    if (!out) {
+      SB_DLOG(WARNING) << "failed to write " << temporary;
+      return;
+    }
+  }
+  if (rename(temporary.c_str(), path.c_str()) != 0) {
+    SB_DLOG(WARNING) << "failed to store " << path;
+    remove(temporary.c_str());
+  }
+}
+
+void UseRegistryCache()
+{
+  if (getenv("GST_REGISTRY")) {
+    return;
+  }
+  std::string path;
+  const char* configured = getenv("COBALT_GST_REGISTRY");
+  if (configured) {
+    path = configured;
+  }
+  else {
+    char directory[SB_FILE_MAX_PATH];
+    if (!SbSystemGetPath(kSbSystemPathCacheDirectory, directory,
+                         sizeof(directory))) {
+      return;
+    }
+    path = std::string(directory) + SB_FILE_SEP_STRING + kRegistryFile;
+  }
+  setenv("GST_REGISTRY", path.c_str(), 1);
+  RegistryPath = path;
+  const std::string key = LoadRegistryKey();
+  if (SbFileExists(path.c_str()) && !key.empty()
+      && key == GetRegistryKey(GetKeyDirectories(key))) {
+    // trust the cache, scanning the plugin directories is the slow part
+    setenv("GST_REGISTRY_UPDATE", "no", 0);
+    RegistryTrusted = true;
+  }
+  else {
+    SB_LOG(INFO) << "updating the GStreamer registry cache " << path;
+  }
+}
+
+// a plugin moved or removed behind a trusted cache, scan after all
+bool RescanStaleRegistry()
+{
+  if (!LoadFailed || !RegistryTrusted) {
+    return false;
+  }
+  SB_LOG(WARNING) << "plugins of the registry cache failed to load, "
+    "rescanning";
+  unsetenv("GST_REGISTRY_UPDATE");
+  gst_update_registry();
+  RegistryTrusted = false;
+  LoadFailed = false;
+  return true;
+}
+
+void RegisterSource()
+{
+  GstElementFactory* srcFactory = gst_element_factory_find("cobaltsrc");
+  if (!srcFactory) {
+    gst_element_register(0, "cobaltsrc", GST_RANK_PRIMARY + 100,
+                         GST_COBALT_TYPE_SRC);
+  }
+  else {
+    gst_object_unref(srcFactory);
+  }
+}
+
+// loads the plugin and initializes the element class, pad templates
+// included, which the first gst_element_factory_make would do otherwise
+bool Pin(GstElementFactory* factory)
+{
+  GstPluginFeature* loaded = gst_plugin_feature_load(
+    GST_PLUGIN_FEATURE(factory));
+  if (!loaded) {
+    LoadFailed = true;
+    return false;
+  }
+  if (std::find(PinnedFeatures.begin(), PinnedFeatures.end(), loaded)
+      != PinnedFeatures.end()) {
+    // pinned before the registry was rescanned
+    gst_object_unref(loaded);
+    return true;
+  }
+  g_type_class_ref(
+    gst_element_factory_get_element_type(GST_ELEMENT_FACTORY(loaded)));
+  PinnedFeatures.push_back(loaded);
+  return true;
+}
+
+void PinFactory(const char* name)
+{
+  GstElementFactory* factory = gst_element_factory_find(name);
+  if (!factory) {
+    SB_DLOG(WARNING) << "no element factory " << name;
+    return;
+  }
+  if (!Pin(factory)) {
+    SB_DLOG(WARNING) << "failed to load " << name;
+  }
+  gst_object_unref(factory);
+}
+
+void PinFactories()
+{
+  for (size_t i = 0; i < sizeof(kFactories) / sizeof(kFactories[0]); ++i) {
+    PinFactory(kFactories[i]);
+  }
+  const SinkProfile& profile = SinkProfile::Get();
+  PinFactory(profile.GetVideoSinkName());
+  PinFactory(profile.GetAudioSinkName());
+  // the chains of the built pipelines
+  for (const char* name : PipelineBuilder::GetFactories()) {
+    PinFactory(name);
+  }
+}
+
+// the best ranked element of |type| accepting |caps|
+void PinBest(GstElementFactoryListType type, GstCaps* caps)
+{
+  GList* all = gst_element_factory_list_get_elements(type, GST_RANK_MARGINAL);
+  GList* accepting
+    = gst_element_factory_list_filter(all, caps, GST_PAD_SINK, FALSE);
+  accepting = g_list_sort(accepting, gst_plugin_feature_rank_compare_func);
+  if (accepting) {
+    Pin(GST_ELEMENT_FACTORY(accepting->data));
+  }
+  gst_plugin_feature_list_free(accepting);
+  gst_plugin_feature_list_free(all);
+}
+
+void PinDecoders()
+{
+  const bool again = !PinnedCaps.empty();
+  for (size_t i = 0; i < sizeof(kStreamCaps) / sizeof(kStreamCaps[0]); ++i) {
+    GstCaps* caps = gst_caps_from_string(kStreamCaps[i]);
+    PinBest(GST_ELEMENT_FACTORY_TYPE_PARSER, caps);
+    PinBest(GST_ELEMENT_FACTORY_TYPE_DECODER, caps);
+    if (again) {
+      gst_caps_unref(caps);
+    }
+    else {
+      PinnedCaps.push_back(caps);
+    }
+  }
+}
+
+gint GetFlagValue(GFlagsClass* flagsClass, const char* name)
+{
+  GFlagsValue* flag = g_flags_get_value_by_nick(flagsClass, name);
+  if (!flag) {
+    SB_DLOG(ERROR) << "no flag value for " << name;
+    return 0;
+  }
+  return flag->value;
+}
+
+gint ResolvePlaybinFlags()
+{
+  // the type comes with the playbin class
+  GType type = g_type_from_name("GstPlayFlags");
+  if (!type) {
+    GstElementFactory* factory = gst_element_factory_find("playbin");
+    if (factory) {
+      Pin(factory);
+      gst_object_unref(factory);
+    }
+    type = g_type_from_name("GstPlayFlags");
+  }
+  if (!type) {
+    SB_DLOG(ERROR) << "no GstPlayFlags, playbin missing";
+    return 0;
+  }
+  GFlagsClass* flagsClass = static_cast<GFlagsClass*>(g_type_class_ref(type));
+  // the class stays referenced
+  return GetFlagValue(flagsClass, "video")
+    | GetFlagValue(flagsClass, "audio")
+    | GetFlagValue(flagsClass, "native-video")
+    | GetFlagValue(flagsClass, "native-audio")
+    | GetFlagValue(flagsClass, "buffering");
+}
+
+// the stages of Run, on the default context thread
+void Load(const std::vector<std::string>& arguments)
+{
+  std::vector<char*> pointers;
+  for (const std::string& argument : arguments) {
+    pointers.push_back(const_cast<char*>(argument.c_str()));
+  }
+  pointers.push_back(nullptr);
+  int argc = static_cast<int>(arguments.size());
+  char** argv = pointers.data();
+
+  StageTimer timer;
+  UseRegistryCache();
+  gst_init(&argc, &argv);
+  timer.Done("init");
+  // before the decoders are pinned, it may change their ranks
+  SinkProfile::Configure(argc, argv);
+  timer.Done("profile");
+  RegisterSource();
+  timer.Done("source");
+  PinFactories();
+  timer.Done("factories");
+  PinDecoders();
+  timer.Done("decoders");
+  if (RescanStaleRegistry()) {
+    PinFactories();
+    PinDecoders();
+    timer.Done("rescan");
+  }
+  StoreRegistryKey();
+  MediaPreload::GetPlaybinFlags();
+  timer.Done("flags");
+  // after the profile ranked the decoders, they are part of the key
+  MediaCapabilities::Get();
+  timer.Done("capabilities");
+  // the common codec pair, ready before the first player is created
+  PipelinePool::Get().Prewarm(kSbMediaVideoCodecH264, kSbMediaAudioCodecAac);
+  timer.Done("pool");
+  SB_LOG(INFO) << "media preload" << timer.ToString() << ", "
+    << PinnedFeatures.size() << " factories pinned";
+  SbAtomicRelease_Store(&Done, 1);
+  Loaded.Put();
+}
+
+} // anonymous namespace
+
+// static
+void MediaPreload::Run(int argc, char** argv)
+{
+  MediaReactor::Get().PostToDefault(
+    std::bind(&Load, std::vector<std::string>(argv, argv + argc)));
+}
+
+// static
+void MediaPreload::Wait()
+{
+  if (SbAtomicAcquire_Load(&Done)) {
+    return;
+  }
+  const SbTime start = SbTimeGetMonotonicNow();
+  Loaded.Take();
+  // the next waiter gets through as well
+  Loaded.Put();
+  SB_DLOG(INFO) << "waited " << (SbTimeGetMonotonicNow() - start) / 1000
+    << "ms for the media preload";
+}
+
+// static
+gint MediaPreload::GetPlaybinFlags()
+{
+  // the playbin factory registers the flags type when loaded
+  static const gint flags = ResolvePlaybinFlags();
+  return flags;
+}
@@ -0,0 +1,57 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <glib.h>
+
+// Startup stage loading what the players need before the first one is
+// created: GStreamer with a registry cache, the cobaltsrc element, the
+// factories of the pipeline, the best parsers and decoders for the
+// supported codecs, the playbin flags and the MediaCapabilities.
+// Everything resolved here stays loaded for the life of the process. Each
+// stage is timed and logged.
+//
+// The stages run on the default context thread of the MediaReactor while
+// the application starts. The media entry points of Starboard wait for
+// them to finish, see Wait.
+//
+// The registry cache is COBALT_GST_REGISTRY, or gstreamer-registry.bin in
+// the cache directory. GStreamer skips the plugin scan while the key stored
+// next to it (.key) still matches: the GStreamer version, the plugin paths
+// and the modification times of the plugin directories. A plugin of the
+// cache failing to load triggers a rescan as well.
+// The sinks and decoders loaded follow the SinkProfile.
+class MediaPreload
+{
+public:
+  // instead of gst_init, on the main thread before the application runs.
+  // Returns at once, the arguments are copied. GStreamer options are not
+  // removed from them
+  static void Run(int argc, char** argv);
+  // blocks till the preload is done, before GStreamer is used. Any thread
+  static void Wait();
+
+  // flags of every playbin, resolved once, any thread
+  static gint GetPlaybinFlags();
+
+private:
+  MediaPreload() = delete;
+};
@@ -0,0 +1,132 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/media_reactor.h"
+
+#include "starboard/common/semaphore.h"
+
+#include "base/logging.h"
+
+#include <memory>
+
+namespace {
+
+void DoCall(void* data)
+{
+  std::unique_ptr<Call> call(reinterpret_cast<Call*>(data));
+  (*call)();
+}
+
+// adapter for GSourceFunc
+gboolean SafeCaller(gpointer userData)
+{
+  DoCall(userData);
+  return G_SOURCE_REMOVE;
+}
+
+// waits till the loop on |context| dispatches
+void WaitForLoop(GMainContext* context)
+{
+  starboard::Semaphore started;
+  g_main_context_invoke(context,
+    &SafeCaller,
+    reinterpret_cast<gpointer>(new Call(std::bind(&starboard::Semaphore::Put,
+                                                  &started))));
+  started.Take();
+}
+
+} // anonymous namespace
+
+// static
+MediaReactor& MediaReactor::Get()
+{
+  // never destroyed, players may still be released at exit
+  static MediaReactor* reactor = new MediaReactor();
+  return *reactor;
+}
+
+MediaReactor::MediaReactor()
+  : DefaultLoop(g_main_loop_new(nullptr, TRUE)),
+  Context(g_main_context_new()),
+  MediaLoop(g_main_loop_new(Context, TRUE))
+{
+  // detached, the loops run till the process ends
+  SbThreadCreate(0, kSbThreadPriorityRealTime, kSbThreadNoAffinity, false,
+                 "media_default", &MediaReactor::DefaultThread, this);
+  SbThreadCreate(0, kSbThreadPriorityRealTime, kSbThreadNoAffinity, false,
+                 "media", &MediaReactor::MediaThread, this);
+  WaitForLoop(nullptr);
+  WaitForLoop(Context);
+  SB_DLOG(INFO) << "media reactor started";
+}
+
+// static
+void* MediaReactor::DefaultThread(void* data)
+{
+  MediaReactor& reactor = *reinterpret_cast<MediaReactor*>(data);
+  g_main_context_push_thread_default(nullptr);
+  g_main_loop_run(reactor.DefaultLoop);
+  return nullptr;
+}
+
+// static
+void* MediaReactor::MediaThread(void* data)
+{
+  MediaReactor& reactor = *reinterpret_cast<MediaReactor*>(data);
+  g_main_context_push_thread_default(reactor.Context);
+  g_main_loop_run(reactor.MediaLoop);
+  return nullptr;
+}
+
+void MediaReactor::Attach(GSource* source)
+{
+  g_source_attach(source, Context);
+}
+
+void MediaReactor::Post(const Call& call)
+{
+  g_main_context_invoke(Context,
+    &SafeCaller,
+    reinterpret_cast<gpointer>(new Call(call)));
+}
+
+void MediaReactor::PostToDefault(const Call& call)
+{
+  GSource* source = g_idle_source_new();
+  g_source_set_callback(source, &SafeCaller,
+    reinterpret_cast<gpointer>(new Call(call)), nullptr);
+  g_source_attach(source, nullptr);
+  g_source_unref(source);
+}
+
+void MediaReactor::RunSync(const Call& call)
+{
+  // the loop holds the context, so only the media thread owns it
+  if (g_main_context_is_owner(Context)) {
+    call();
+    return;
+  }
+  starboard::Semaphore done;
+  Post([&call, &done]() {
+    call();
+    done.Put();
+  });
+  done.Take();
+}
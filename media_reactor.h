@@ -0,0 +1,66 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/thread.h"
+
+#include <glib.h>
+
+#include <functional>
+
+typedef std::function<void()> Call;
+
+// Process wide threads running the GLib loops of all players: one on the
+// global default context, for elements attaching their sources there, and
+// one on the media context, for the per player bus watches, command queues
+// and timers. Started on first use and kept for the life of the process,
+// so creating a player spawns no thread.
+class MediaReactor
+{
+public:
+  static MediaReactor& Get();
+
+  GMainContext* GetContext() const {
+    return Context;
+  }
+  // attaches |source| to the media context, the reference stays with caller
+  void Attach(GSource* source);
+  // runs |call| on the media thread, without waiting
+  void Post(const Call& call);
+  // runs |call| on the default context thread, without waiting
+  void PostToDefault(const Call& call);
+  // runs |call| on the media thread and waits for it. Once a player's
+  // sources are destroyed this way, none of its callbacks is running
+  void RunSync(const Call& call);
+
+private:
+  MediaReactor();
+
+  static void* DefaultThread(void* data);
+  static void* MediaThread(void* data);
+
+  GMainLoop* const DefaultLoop;
+  GMainContext* const Context;
+  GMainLoop* const MediaLoop;
+
+  MediaReactor(const MediaReactor&) = delete;
+  MediaReactor& operator=(const MediaReactor&) = delete;
+};
@@ -0,0 +1,822 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+// Micro benchmarks for the player hot paths, per sample or per call. Each
+// case prints one line:
+//   <name> <ns/op> <worst ns> <allocations/op>
+// The worst time is that of a single iteration, a whole burst for the
+// queued cases. Allocations count malloc, calloc, realloc and the aligned
+// allocators (g_slice before GLib 2.76) of the whole process during the
+// timed pass, so those of consumer threads too.
+// The ingest, command and query cases run the player code itself, on a
+// player of the passthrough SinkProfile: no parsing or decoding, the
+// samples reach appsink as written.
+// A last, untimed check seeks inside the retained sample window and fails
+// the run when a video sample reaches the sink twice.
+//
+//   media_microbenchmark [iterations]
+
+#include "third_party/starboard/raspi/wayland/command_queue.h"
+#include "third_party/starboard/raspi/wayland/media_preload.h"
+#include "third_party/starboard/raspi/wayland/media_reactor.h"
+#include "third_party/starboard/raspi/wayland/player_private.h"
+#include "third_party/starboard/raspi/wayland/sample_pool.h"
+#include "third_party/starboard/raspi/wayland/snapshot.h"
+
+#include "starboard/atomic.h"
+#include "starboard/common/mutex.h"
+#include "starboard/common/semaphore.h"
+#include "starboard/player.h"
+#include "starboard/thread.h"
+#include "starboard/time.h"
+
+#include <gst/gst.h>
+#include <gst/app/gstappsrc.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <map>
+
+namespace {
+
+SbAtomic32 Allocations = 0;
+
+} // anonymous namespace
+
+// counting wrappers around the glibc allocator, g_malloc ends up here too
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+
+void* malloc(size_t size)
+{
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size)
+{
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  return __libc_realloc(pointer, size);
+}
+
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* memalign(size_t alignment, size_t size)
+{
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size)
+{
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size)
+{
+  // a power of two multiple of sizeof(void*)
+  if (alignment % sizeof(void*) || (alignment & (alignment - 1))) {
+    return EINVAL;
+  }
+  SbAtomicNoBarrier_Increment(&Allocations, 1);
+  void* memory = __libc_memalign(alignment, size);
+  if (!memory && size) {
+    return ENOMEM;
+  }
+  *pointer = memory;
+  return 0;
+}
+
+} // extern "C"
+
+namespace {
+
+const int kDefaultIterations = 1000000;
+// the cases going through GStreamer run this fraction of the iterations
+const int kGstIterationDivisor = 10;
+// commands posted before waiting for the media thread to handle them
+const int kCommandBurst = 64;
+const int kSampleSize = 4096;
+const int kMaxFragments = 4;
+const uint8_t kSample[kSampleSize] = {};
+// AAC LC, 44.1 kHz, stereo
+const uint8_t kAacConfig[] = { 0x12, 0x10 };
+const int kFps = 30;
+const int kGop = 60;
+const SbTime kReadyTimeout = 10 * kSbTimeSecond;
+
+// the mutex guarded template player info used to live in
+template <typename T>
+class MutexSnapshot
+{
+public:
+  MutexSnapshot() : Value() {}
+  T Load() const {
+    starboard::ScopedLock lock(Mutex);
+    return Value;
+  }
+  void Store(const T& value) {
+    starboard::ScopedLock lock(Mutex);
+    Value = value;
+  }
+
+private:
+  T Value;
+  mutable starboard::Mutex Mutex;
+};
+
+struct Result
+{
+  double NsPerOp;
+  SbTime Worst;
+  double AllocationsPerOp;
+};
+
+void Report(const char* name, const Result& result)
+{
+  printf("%-40s %10.1f %10lld %10.2f\n", name, result.NsPerOp,
+         static_cast<long long>(result.Worst * 1000),
+         result.AllocationsPerOp);
+}
+
+// runs |iteration| |iterations| times, each doing |opsPerIteration| ops
+Result Measure(int iterations, int opsPerIteration,
+               const std::function<void()>& iteration)
+{
+  Result result = { 0.0, 0, 0.0 };
+  const double ops = static_cast<double>(iterations) * opsPerIteration;
+  const SbAtomic32 allocations = SbAtomicNoBarrier_Load(&Allocations);
+  const SbTime start = SbTimeGetMonotonicNow();
+  for (int i = 0; i < iterations; ++i) {
+    iteration();
+  }
+  const SbTime total = SbTimeGetMonotonicNow() - start;
+  result.NsPerOp = static_cast<double>(total) * 1000.0 / ops;
+  result.AllocationsPerOp
+    = (SbAtomicNoBarrier_Load(&Allocations) - allocations) / ops;
+
+  // separate pass, the clock reads would distort the average
+  for (int i = 0; i < iterations; ++i) {
+    const SbTime before = SbTimeGetMonotonicNow();
+    iteration();
+    const SbTime took = SbTimeGetMonotonicNow() - before;
+    if (took > result.Worst) {
+      result.Worst = took;
+    }
+  }
+  return result;
+}
+
+template <typename S>
+struct WriterContext
+{
+  S* Info;
+  SbAtomic32 Stop;
+};
+
+// stores as fast as possible, the worst case for readers
+template <typename S>
+void* Writer(void* data)
+{
+  WriterContext<S>& context = *reinterpret_cast<WriterContext<S>*>(data);
+  SbPlayerInfo2 info = SbPlayerInfo2();
+  while (!SbAtomicAcquire_Load(&context.Stop)) {
+    ++info.current_media_timestamp;
+    ++info.total_video_frames;
+    context.Info->Store(info);
+  }
+  return nullptr;
+}
+
+template <typename S>
+Result MeasureLoad(int iterations, bool contended)
+{
+  S info;
+  WriterContext<S> context = { &info, 0 };
+  SbThread writer = kSbThreadInvalid;
+  if (contended) {
+    writer = SbThreadCreate(0, kSbThreadPriorityNormal, kSbThreadNoAffinity,
+                            true, "writer", &Writer<S>, &context);
+  }
+
+  int64_t checksum = 0;
+  const Result result = Measure(iterations, 1, [&info, &checksum]() {
+    checksum += info.Load().current_media_timestamp;
+  });
+
+  if (contended) {
+    SbAtomicRelease_Store(&context.Stop, 1);
+    SbThreadJoin(writer, nullptr);
+  }
+  if (checksum < 0) {
+    printf("impossible checksum\n");
+  }
+  return result;
+}
+
+void CountDeallocation(SbPlayer, void* context, const void*)
+{
+  ++*reinterpret_cast<int64_t*>(context);
+}
+
+// WriteSample turning a sample into a buffer, |fragments| pieces of it
+Result MeasureSampleWrap(int iterations, int fragments)
+{
+  int64_t deallocated = 0;
+  SamplePool* pool = SamplePool::Create(kSbPlayerInvalid, &CountDeallocation,
+                                        &deallocated);
+  const int fragmentSize = kSampleSize / fragments;
+  const void* buffers[kMaxFragments];
+  int sizes[kMaxFragments];
+  for (int i = 0; i < fragments; ++i) {
+    buffers[i] = kSample + i * fragmentSize;
+    sizes[i] = fragmentSize;
+  }
+  SbTime pts = 0;
+  const Result result = Measure(iterations, 1, [&]() {
+    GstBuffer* buffer = pool->Wrap(kSbMediaTypeVideo, buffers, sizes,
+                                   fragments);
+    GST_BUFFER_PTS(buffer) = pts++ * GST_USECOND;
+    gst_buffer_unref(buffer);
+  });
+  pool->Release();
+  if (deallocated != 2 * static_cast<int64_t>(iterations)) {
+    printf("deallocated %lld samples of %d\n",
+           static_cast<long long>(deallocated), 2 * iterations);
+  }
+  return result;
+}
+
+// the same with a fresh buffer and wrapped memory per sample, as before the
+// sample pool
+Result MeasureSampleWrapUnpooled(int iterations)
+{
+  SbTime pts = 0;
+  return Measure(iterations, 1, [&pts]() {
+    GstBuffer* buffer = gst_buffer_new();
+    gst_buffer_append_memory(buffer, gst_memory_new_wrapped(
+      GST_MEMORY_FLAG_READONLY, const_cast<uint8_t*>(kSample), kSampleSize,
+      0, kSampleSize, nullptr, nullptr));
+    GST_BUFFER_PTS(buffer) = pts++ * GST_USECOND;
+    gst_buffer_unref(buffer);
+  });
+}
+
+// appsrc ! fakesink, consuming as fast as it can
+class AppSrcPipeline
+{
+public:
+  AppSrcPipeline()
+    : Pipeline(gst_pipeline_new("bench")),
+    Source(gst_element_factory_make("appsrc", nullptr)),
+    Sink(gst_element_factory_make("fakesink", nullptr))
+  {
+    GstCaps* caps = gst_caps_new_empty_simple("video/x-h264");
+    g_object_set(Source, "caps", caps, "format", GST_FORMAT_TIME,
+                 "block", TRUE, "max-bytes",
+                 static_cast<guint64>(64 * kSampleSize), nullptr);
+    gst_caps_unref(caps);
+    g_object_set(Sink, "sync", FALSE, nullptr);
+    gst_bin_add_many(GST_BIN(Pipeline), Source, Sink, nullptr);
+    gst_element_link(Source, Sink);
+    gst_element_set_state(Pipeline, GST_STATE_PLAYING);
+  }
+  ~AppSrcPipeline() {
+    gst_element_set_state(Pipeline, GST_STATE_NULL);
+    gst_object_unref(Pipeline);
+  }
+
+  GstAppSrc* GetSource() const {
+    return GST_APP_SRC(Source);
+  }
+
+private:
+  GstElement* const Pipeline;
+  GstElement* const Source;
+  GstElement* const Sink;
+
+  AppSrcPipeline(const AppSrcPipeline&) = delete;
+  AppSrcPipeline& operator=(const AppSrcPipeline&) = delete;
+};
+
+// the push thread half alone, pooled samples straight into appsrc
+Result MeasureAppSrcPush(int iterations)
+{
+  SamplePool* pool = SamplePool::Create(kSbPlayerInvalid, nullptr, nullptr);
+  const void* buffers[] = { kSample };
+  const int sizes[] = { kSampleSize };
+  Result result;
+  {
+    AppSrcPipeline pipeline;
+    SbTime pts = 0;
+    result = Measure(iterations, 1, [&]() {
+      GstBuffer* buffer = pool->Wrap(kSbMediaTypeVideo, buffers, sizes, 1);
+      GST_BUFFER_PTS(buffer) = pts++ * GST_USECOND;
+      gst_app_src_push_buffer(pipeline.GetSource(), buffer);
+    });
+  }
+  pool->Release();
+  return result;
+}
+
+// a player created through the Starboard API, presenting and ready for
+// more samples. the samples written run the whole ingest path: sample pool,
+// decoder queue, cobaltsrc pad task and the sinks
+class IngestPlayer
+{
+public:
+  IngestPlayer()
+    : Player(kSbPlayerInvalid),
+    Ticket(0),
+    Presenting(false),
+    NeedsVideo(false),
+    NeedsAudio(false),
+    Frame(0)
+  {
+    SbMediaAudioSampleInfo header = SbMediaAudioSampleInfo();
+    header.format_tag = 0xff;
+    header.number_of_channels = 2;
+    header.samples_per_second = 44100;
+    header.bits_per_sample = 16;
+    header.audio_specific_config_size = sizeof(kAacConfig);
+    header.audio_specific_config = kAacConfig;
+    Player = SbPlayerCreate(kSbWindowInvalid, kSbMediaVideoCodecH264,
+                            kSbMediaAudioCodecAac, kSbDrmSystemInvalid,
+                            &header,
+#if SB_API_VERSION >= 11
+                            "",
+#endif
+                            &IngestPlayer::Deallocate,
+                            &IngestPlayer::DecoderStatus,
+                            &IngestPlayer::PlayerStatus,
+                            &IngestPlayer::PlayerError, this,
+                            kSbPlayerOutputModePunchOut, nullptr);
+    if (!SbPlayerIsValid(Player)) {
+      return;
+    }
+    SbPlayerSetPlaybackRate(Player, 1.0);
+    if (Seek(0)) {
+      WriteVideo();
+      WaitFor(&Presenting);
+    }
+  }
+  ~IngestPlayer() {
+    if (SbPlayerIsValid(Player)) {
+      SbPlayerDestroy(Player);
+    }
+  }
+
+  bool IsReady() {
+    starboard::ScopedLock lock(Mutex);
+    return Presenting;
+  }
+
+  // as Cobalt, writes once the decoders ask for samples again: an audio
+  // frame at |position|, video is up to the caller. false on a timeout
+  bool Seek(SbTime position) {
+    int ticket;
+    {
+      starboard::ScopedLock lock(Mutex);
+      ticket = ++Ticket;
+      Presenting = false;
+      NeedsVideo = false;
+      NeedsAudio = false;
+    }
+    SbPlayerSeek(Player, position, ticket);
+    if (!WaitFor(&NeedsVideo) || !WaitFor(&NeedsAudio)) {
+      return false;
+    }
+    const void* buffers[] = { kSample };
+    const int sizes[] = { kSampleSize };
+    SbPlayerWriteSample(Player, kSbMediaTypeAudio, buffers, sizes, 1,
+                        position, nullptr, nullptr);
+    return true;
+  }
+
+  // the next video frame, a key frame at the start of each GOP
+  void WriteVideo() {
+    const void* buffers[] = { kSample };
+    const int sizes[] = { kSampleSize };
+    SbMediaVideoSampleInfo info = SbMediaVideoSampleInfo();
+    info.is_key_frame = Frame % kGop == 0;
+    info.frame_width = 1920;
+    info.frame_height = 1080;
+    SbPlayerWriteSample(Player, kSbMediaTypeVideo, buffers, sizes, 1,
+                        GetPts(Frame), &info, nullptr);
+    ++Frame;
+  }
+  int64_t GetFrame() const {
+    return Frame;
+  }
+  // the next WriteVideo writes |frame| again
+  void Rewind(int64_t frame) {
+    Frame = frame;
+  }
+  static SbTime GetPts(int64_t frame) {
+    return frame * kSbTimeSecond / kFps;
+  }
+
+  // the src pad of the player's cobaltsrc carrying video or audio, a new
+  // reference
+  GstPad* GetSourcePad(bool video) const {
+    GstElement* source = Player->GetSource();
+    if (!source) {
+      return nullptr;
+    }
+    GstPad* pad = nullptr;
+    GstIterator* pads = gst_element_iterate_src_pads(source);
+    GValue item = G_VALUE_INIT;
+    while (!pad && gst_iterator_next(pads, &item) == GST_ITERATOR_OK) {
+      GstPad* candidate = GST_PAD(g_value_get_object(&item));
+      GstCaps* caps = gst_pad_get_current_caps(candidate);
+      const GstStructure* s = caps ? gst_caps_get_structure(caps, 0) : nullptr;
+      if (s && g_str_has_prefix(gst_structure_get_name(s), "video/")
+          == (video ? TRUE : FALSE)) {
+        pad = GST_PAD(gst_object_ref(candidate));
+      }
+      if (caps) {
+        gst_caps_unref(caps);
+      }
+      g_value_reset(&item);
+    }
+    g_value_unset(&item);
+    gst_iterator_free(pads);
+    return pad;
+  }
+
+private:
+  bool WaitFor(const bool* flag) {
+    const SbTime deadline = SbTimeGetMonotonicNow() + kReadyTimeout;
+    for (;;) {
+      {
+        starboard::ScopedLock lock(Mutex);
+        if (*flag) {
+          return true;
+        }
+      }
+      const SbTime left = deadline - SbTimeGetMonotonicNow();
+      if (left <= 0) {
+        return false;
+      }
+      Wakeup.TakeWait(left);
+    }
+  }
+
+  static void Deallocate(SbPlayer, void*, const void*) {
+    // the sample is static
+  }
+
+  static void DecoderStatus(SbPlayer, void* context, SbMediaType type,
+                            SbPlayerDecoderState state, int ticket) {
+    IngestPlayer& p = *reinterpret_cast<IngestPlayer*>(context);
+    if (state != kSbPlayerDecoderStateNeedsData) {
+      return;
+    }
+    {
+      starboard::ScopedLock lock(p.Mutex);
+      if (ticket != p.Ticket) {
+        return;
+      }
+      (type == kSbMediaTypeVideo ? p.NeedsVideo : p.NeedsAudio) = true;
+    }
+    p.Wakeup.Put();
+  }
+
+  static void PlayerStatus(SbPlayer, void* context, SbPlayerState state,
+                           int ticket) {
+    IngestPlayer& p = *reinterpret_cast<IngestPlayer*>(context);
+    if (state != kSbPlayerStatePresenting) {
+      return;
+    }
+    {
+      starboard::ScopedLock lock(p.Mutex);
+      if (ticket != p.Ticket) {
+        return;
+      }
+      p.Presenting = true;
+    }
+    p.Wakeup.Put();
+  }
+
+  static void PlayerError(SbPlayer, void*, SbPlayerError,
+                          const char* message) {
+    fprintf(stderr, "player error: %s\n", message ? message : "");
+  }
+
+  SbPlayer Player;
+
+  // shared with the callbacks
+  starboard::Mutex Mutex;
+  starboard::Semaphore Wakeup;
+  int Ticket;
+  bool Presenting;
+  bool NeedsVideo;
+  bool NeedsAudio;
+
+  // the benchmark thread only
+  int64_t Frame;
+
+  IngestPlayer(const IngestPlayer&) = delete;
+  IngestPlayer& operator=(const IngestPlayer&) = delete;
+};
+
+// SbPlayerWriteSample of one video sample, until it is pushed downstream
+// by the pad task. the ring bounds how far the writer runs ahead
+Result MeasureWriteSample(int iterations, IngestPlayer& player)
+{
+  return Measure(iterations, 1, [&player]() {
+    player.WriteVideo();
+  });
+}
+
+// the pts of the buffers going through a pad
+class PtsRecorder
+{
+public:
+  explicit PtsRecorder(GstPad* pad)
+    : Pad(pad),
+    Probe(gst_pad_add_probe(pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER
+                                   | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      &PtsRecorder::OnData, this, nullptr))
+  {
+  }
+  ~PtsRecorder() {
+    gst_pad_remove_probe(Pad, Probe);
+  }
+
+  void Reset() {
+    starboard::ScopedLock lock(Mutex);
+    Seen.clear();
+  }
+  bool HasSeen(SbTime pts) {
+    starboard::ScopedLock lock(Mutex);
+    return Seen.count(pts * GST_USECOND) > 0;
+  }
+  // pts seen more than once since the last Reset
+  int GetRepeated() {
+    starboard::ScopedLock lock(Mutex);
+    int repeated = 0;
+    for (const auto& seen : Seen) {
+      repeated += seen.second > 1;
+    }
+    return repeated;
+  }
+
+private:
+  static GstPadProbeReturn OnData(GstPad*, GstPadProbeInfo* info,
+                                  gpointer data) {
+    PtsRecorder& recorder = *reinterpret_cast<PtsRecorder*>(data);
+    starboard::ScopedLock lock(recorder.Mutex);
+    if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+      GstBufferList* list = GST_PAD_PROBE_INFO_BUFFER_LIST(info);
+      for (guint i = 0; i < gst_buffer_list_length(list); ++i) {
+        ++recorder.Seen[GST_BUFFER_PTS(gst_buffer_list_get(list, i))];
+      }
+    }
+    else {
+      ++recorder.Seen[GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info))];
+    }
+    return GST_PAD_PROBE_OK;
+  }
+
+  GstPad* const Pad;
+  const gulong Probe;
+  starboard::Mutex Mutex;
+  std::map<GstClockTime, int> Seen;
+
+  PtsRecorder(const PtsRecorder&) = delete;
+  PtsRecorder& operator=(const PtsRecorder&) = delete;
+};
+
+bool WaitForPts(PtsRecorder& recorder, SbTime pts)
+{
+  const SbTime deadline = SbTimeGetMonotonicNow() + kReadyTimeout;
+  while (!recorder.HasSeen(pts)) {
+    if (SbTimeGetMonotonicNow() > deadline) {
+      return false;
+    }
+    SbThreadSleep(kSbTimeMillisecond);
+  }
+  return true;
+}
+
+// a seek inside the retained window on a player of its own: the window is
+// pushed again from the key frame, then Cobalt writes the same group of
+// pictures once more and continues. returns the video pts pushed twice
+// after the seek, -1 when the player did not get that far
+int CheckSeekReplay()
+{
+  setenv("COBALT_MEDIA_RETAIN_MS", "10000", 1);
+  IngestPlayer player;
+  unsetenv("COBALT_MEDIA_RETAIN_MS");
+  GstPad* pad = player.IsReady() ? player.GetSourcePad(true) : nullptr;
+  if (!pad) {
+    return -1;
+  }
+  int repeated = -1;
+  {
+    PtsRecorder recorder(pad);
+    while (player.GetFrame() < 2 * kGop) {
+      player.WriteVideo();
+    }
+    const int64_t extra = 10;
+    if (WaitForPts(recorder, IngestPlayer::GetPts(2 * kGop - 1))) {
+      recorder.Reset();
+      if (player.Seek(IngestPlayer::GetPts(kGop + kGop / 2))) {
+        player.Rewind(kGop);
+        while (player.GetFrame() < 2 * kGop + extra) {
+          player.WriteVideo();
+        }
+        if (WaitForPts(recorder, IngestPlayer::GetPts(2 * kGop + extra - 1))) {
+          // a late repeat would follow right after
+          SbThreadSleep(100 * kSbTimeMillisecond);
+          repeated = recorder.GetRepeated();
+        }
+      }
+    }
+  }
+  gst_object_unref(pad);
+  return repeated;
+}
+
+// handled commands, the burst is done when Remaining reaches 0
+struct CommandCounter
+{
+  SbAtomic32 Remaining;
+  starboard::Semaphore Done;
+
+  void Handled() {
+    if (SbAtomicBarrier_Increment(&Remaining, -1) == 0) {
+      Done.Put();
+    }
+  }
+};
+
+void HandleCommand(const PlayerCommand&, void* context)
+{
+  reinterpret_cast<CommandCounter*>(context)->Handled();
+}
+
+// the queue of a player, handled on the media thread
+Result MeasureCommandQueue(int iterations)
+{
+  CommandCounter counter;
+  CommandQueue queue;
+  queue.Attach(MediaReactor::Get().GetContext(), &HandleCommand, &counter);
+  PlayerCommand command = PlayerCommand();
+  command.Type = PlayerCommand::kNeedsData;
+  const Result result = Measure(iterations, kCommandBurst, [&]() {
+    SbAtomicNoBarrier_Store(&counter.Remaining, kCommandBurst);
+    for (int i = 0; i < kCommandBurst; ++i) {
+      queue.Post(command);
+    }
+    counter.Done.Take();
+  });
+  queue.Detach();
+  return result;
+}
+
+// the per call marshalling players used before the command queue, an
+// invocation on the media context each
+Result MeasureReactorPost(int iterations)
+{
+  CommandCounter counter;
+  PlayerCommand command = PlayerCommand();
+  command.Type = PlayerCommand::kNeedsData;
+  MediaReactor& reactor = MediaReactor::Get();
+  return Measure(iterations, kCommandBurst, [&]() {
+    SbAtomicNoBarrier_Store(&counter.Remaining, kCommandBurst);
+    for (int i = 0; i < kCommandBurst; ++i) {
+      reactor.Post(std::bind(&HandleCommand, command, &counter));
+    }
+    counter.Done.Take();
+  });
+}
+
+// a seeking query on a ghost pad of a bin around appsrc, answered by
+// appsrc through the default proxy pad, as a baseline
+Result MeasureProxyQuery(int iterations)
+{
+  GstElement* bin = gst_bin_new(nullptr);
+  GstElement* appsrc = gst_element_factory_make("appsrc", nullptr);
+  g_object_set(appsrc, "format", GST_FORMAT_TIME, nullptr);
+  gst_bin_add(GST_BIN(bin), appsrc);
+  GstPad* target = gst_element_get_static_pad(appsrc, "src");
+  GstPad* pad = gst_ghost_pad_new("src", target);
+  gst_object_unref(target);
+  gst_pad_set_active(pad, TRUE);
+  gst_element_add_pad(bin, pad);
+  gst_element_set_state(bin, GST_STATE_READY);
+
+  GstQuery* query = gst_query_new_seeking(GST_FORMAT_TIME);
+  const Result result = Measure(iterations, 1, [pad, query]() {
+    gst_pad_query(pad, query);
+  });
+  gst_query_unref(query);
+  gst_element_set_state(bin, GST_STATE_NULL);
+  gst_object_unref(bin);
+  return result;
+}
+
+// |query| on a src pad of the player's cobaltsrc, answered by its query
+// function
+Result MeasureSourceQuery(int iterations, IngestPlayer& player,
+                          GstQuery* query)
+{
+  GstPad* pad = player.GetSourcePad(true);
+  if (!pad) {
+    gst_query_unref(query);
+    return Result();
+  }
+  const Result result = Measure(iterations, 1, [pad, query]() {
+    gst_pad_query(pad, query);
+  });
+  gst_query_unref(query);
+  gst_object_unref(pad);
+  return result;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv)
+{
+  // the samples skip parsers and decoders, only the ingest path is timed
+  setenv("COBALT_MEDIA_SINK_PROFILE", "appsink,nosync,passthrough", 1);
+  setenv("COBALT_MEDIA_PIPELINE", "built", 1);
+  MediaPreload::Run(argc, argv);
+  MediaPreload::Wait();
+  const int iterations = argc > 1 ? atoi(argv[1]) : kDefaultIterations;
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+  const int gstIterations = iterations / kGstIterationDivisor > 0
+    ? iterations / kGstIterationDivisor : 1;
+  const int commandIterations = gstIterations / kCommandBurst > 0
+    ? gstIterations / kCommandBurst : 1;
+
+  printf("%-40s %10s %10s %10s\n", "case", "ns/op", "worst ns", "allocs/op");
+  Report("info_load_mutex",
+         MeasureLoad<MutexSnapshot<SbPlayerInfo2> >(iterations, false));
+  Report("info_load_snapshot",
+         MeasureLoad<Snapshot<SbPlayerInfo2> >(iterations, false));
+  Report("info_load_mutex_contended",
+         MeasureLoad<MutexSnapshot<SbPlayerInfo2> >(iterations, true));
+  Report("info_load_snapshot_contended",
+         MeasureLoad<Snapshot<SbPlayerInfo2> >(iterations, true));
+  Report("sample_wrap_unpooled", MeasureSampleWrapUnpooled(gstIterations));
+  Report("sample_wrap", MeasureSampleWrap(gstIterations, 1));
+  Report("sample_wrap_4_fragments",
+         MeasureSampleWrap(gstIterations, kMaxFragments));
+  Report("appsrc_push", MeasureAppSrcPush(gstIterations));
+  Report("command_reactor_post", MeasureReactorPost(commandIterations));
+  Report("command_queue_post", MeasureCommandQueue(commandIterations));
+  Report("source_query_proxy", MeasureProxyQuery(gstIterations));
+
+  IngestPlayer player;
+  if (!player.IsReady()) {
+    fprintf(stderr, "no player presenting, ingest cases skipped\n");
+    return 1;
+  }
+  Report("player_write_sample", MeasureWriteSample(gstIterations, player));
+  Report("source_query_seeking", MeasureSourceQuery(
+    gstIterations, player, gst_query_new_seeking(GST_FORMAT_TIME)));
+  Report("source_query_buffering", MeasureSourceQuery(
+    gstIterations, player, gst_query_new_buffering(GST_FORMAT_TIME)));
+
+  // not timed, a local seek must not push a sample twice
+  const int repeated = CheckSeekReplay();
+  printf("%-40s %10d\n", "seek_replay_repeated_samples", repeated);
+  return repeated == 0 ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/pipeline_builder.h"
+#include "third_party/starboard/raspi/wayland/cobalt_source.h"
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
+
+#include "base/logging.h"
+
+#include <gst/gst.h>
+
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+const int kMaxDecoders = 3;
+
+struct Chain
+{
+  // nullptr when the decoder takes the stream as written
+  const char* Parser;
+  // by preference, the first one installed and not demoted is used
+  const char* Decoders[kMaxDecoders];
+};
+
+struct VideoChain
+{
+  SbMediaVideoCodec Codec;
+  Chain Elements;
+};
+
+struct AudioChain
+{
+  SbMediaAudioCodec Codec;
+  Chain Elements;
+};
+
+// hardware first, the software profile takes it out by its rank
+const VideoChain kVideoChains[] = {
+  { kSbMediaVideoCodecH264,
+    { "h264parse", { "omxh264dec", "avdec_h264", nullptr } } },
+  { kSbMediaVideoCodecMpeg2,
+    { "mpegvideoparse", { "omxmpeg2videodec", "avdec_mpeg2video", nullptr } } },
+  { kSbMediaVideoCodecVc1,
+    { "vc1parse", { "omxwmvdec", "avdec_vc1", nullptr } } },
+  { kSbMediaVideoCodecVp8,
+    { nullptr, { "omxvp8dec", "vp8dec", nullptr } } },
+};
+
+const AudioChain kAudioChains[] = {
+  { kSbMediaAudioCodecAac,
+    { "aacparse", { "avdec_aac", "faad", "fdkaacdec" } } },
+};
+
+const Chain* FindChain(SbMediaVideoCodec codec)
+{
+  for (const VideoChain& c : kVideoChains) {
+    if (c.Codec == codec) {
+      return &c.Elements;
+    }
+  }
+  return nullptr;
+}
+
+const Chain* FindChain(SbMediaAudioCodec codec)
+{
+  for (const AudioChain& c : kAudioChains) {
+    if (c.Codec == codec) {
+      return &c.Elements;
+    }
+  }
+  return nullptr;
+}
+
+bool IsInstalled(const char* name, bool ranked)
+{
+  GstPluginFeature* feature
+    = GST_PLUGIN_FEATURE(gst_element_factory_find(name));
+  if (!feature) {
+    return false;
+  }
+  // the sink profile demotes the decoders it does not want
+  const bool usable = !ranked
+    || gst_plugin_feature_get_rank(feature) != GST_RANK_NONE;
+  gst_object_unref(feature);
+  return usable;
+}
+
+const char* FindDecoder(const Chain& chain)
+{
+  for (const char* name : chain.Decoders) {
+    if (name && IsInstalled(name, true)) {
+      return name;
+    }
+  }
+  return nullptr;
+}
+
+void Discard(GstElement* element)
+{
+  if (element) {
+    gst_object_unref(gst_object_ref_sink(element));
+  }
+}
+
+// adds parser, decoder and |sink| to |bin| and links them. returns the
+// first element of the chain, nullptr if it can't be built. takes |sink|
+GstElement* AddChain(GstBin* bin, const Chain* chain, GstElement* sink)
+{
+  if (SinkProfile::Get().IsPassthrough()) {
+    // the samples go to the sink as written
+    if (!sink) {
+      return nullptr;
+    }
+    gst_bin_add(bin, sink);
+    return sink;
+  }
+  const char* decoderName = chain ? FindDecoder(*chain) : nullptr;
+  GstElement* parser = decoderName && chain->Parser
+    ? gst_element_factory_make(chain->Parser, nullptr) : nullptr;
+  GstElement* decoder = decoderName
+    ? gst_element_factory_make(decoderName, nullptr) : nullptr;
+  if (!sink || !decoder || (chain->Parser && !parser)) {
+    Discard(parser);
+    Discard(decoder);
+    Discard(sink);
+    return nullptr;
+  }
+  gst_bin_add_many(bin, decoder, sink, nullptr);
+  if (parser) {
+    gst_bin_add(bin, parser);
+  }
+  // the elements belong to |bin| from here on
+  if (!gst_element_link(decoder, sink)
+      || (parser && !gst_element_link(parser, decoder))) {
+    return nullptr;
+  }
+  return parser ? parser : decoder;
+}
+
+bool LinkStream(GstElement* source, AbstractDecoder* decoder,
+                GstElement* chain)
+{
+  GstPad* sourcePad = CobaltSourceGetPad(source, decoder);
+  GstPad* chainPad = gst_element_get_static_pad(chain, "sink");
+  const bool linked = sourcePad && chainPad
+    && GST_PAD_LINK_SUCCESSFUL(gst_pad_link(sourcePad, chainPad));
+  if (sourcePad) {
+    gst_object_unref(sourcePad);
+  }
+  if (chainPad) {
+    gst_object_unref(chainPad);
+  }
+  return linked;
+}
+
+bool IsPlaybinForced()
+{
+  const char* value = getenv("COBALT_MEDIA_PIPELINE");
+  return value && strcmp(value, "playbin") == 0;
+}
+
+} // anonymous namespace
+
+// static
+bool PipelineBuilder::IsEnabled()
+{
+  static const bool enabled = !IsPlaybinForced();
+  return enabled;
+}
+
+// static
+bool PipelineBuilder::Build(SbMediaVideoCodec video, SbMediaAudioCodec audio,
+                            PipelinePool::Pipeline* pipeline)
+{
+  const Chain* videoChain = FindChain(video);
+  const Chain* audioChain = FindChain(audio);
+  if (!IsEnabled() || !videoChain || !audioChain) {
+    return false;
+  }
+  GstElement* bin = gst_pipeline_new(nullptr);
+  GstElement* source = gst_element_factory_make("cobaltsrc", nullptr);
+  if (!source) {
+    gst_object_unref(bin);
+    return false;
+  }
+  gst_bin_add(GST_BIN(bin), source);
+
+  const SinkProfile& profile = SinkProfile::Get();
+  GstElement* videoSink = profile.CreateVideoSink();
+  GstElement* audioSink = profile.CreateAudioSink();
+  GstElement* videoHead = AddChain(GST_BIN(bin), videoChain, videoSink);
+  GstElement* audioHead
+    = videoHead ? AddChain(GST_BIN(bin), audioChain, audioSink) : nullptr;
+  if (!audioHead) {
+    SB_DLOG(WARNING) << "no explicit pipeline for video codec " << video
+      << " and audio codec " << audio << ", using playbin";
+    if (!videoHead) {
+      Discard(audioSink);
+    }
+    gst_object_unref(bin);
+    return false;
+  }
+  pipeline->Playbin = bin;
+  pipeline->VideoSink = videoSink;
+  pipeline->AudioSink = audioSink;
+  pipeline->Source = source;
+  pipeline->VideoChain = videoHead;
+  pipeline->AudioChain = audioHead;
+  return true;
+}
+
+// static
+bool PipelineBuilder::Link(const PipelinePool::Pipeline& pipeline,
+                           AbstractDecoder* audio, AbstractDecoder* video)
+{
+  CobaltSourceRegisterPlayer(pipeline.Source, audio, video);
+  return LinkStream(pipeline.Source, audio, pipeline.AudioChain)
+    && LinkStream(pipeline.Source, video, pipeline.VideoChain);
+}
+
+// static
+std::vector<const char*> PipelineBuilder::GetFactories()
+{
+  std::vector<const char*> factories;
+  if (!IsEnabled()) {
+    return factories;
+  }
+  std::vector<const Chain*> chains;
+  for (const VideoChain& c : kVideoChains) {
+    chains.push_back(&c.Elements);
+  }
+  for (const AudioChain& c : kAudioChains) {
+    chains.push_back(&c.Elements);
+  }
+  for (const Chain* chain : chains) {
+    const char* decoder = FindDecoder(*chain);
+    if (!decoder) {
+      continue;
+    }
+    if (chain->Parser && IsInstalled(chain->Parser, false)) {
+      factories.push_back(chain->Parser);
+    }
+    factories.push_back(decoder);
+  }
+  return factories;
+}
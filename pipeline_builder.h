@@ -0,0 +1,53 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "third_party/starboard/raspi/wayland/pipeline_pool.h"
+
+#include "starboard/media.h"
+
+#include <vector>
+
+class AbstractDecoder;
+
+// Builds the pipeline of a player without playbin: cobaltsrc and, per
+// stream, parser -> decoder -> sink straight from a codec table, as the
+// codecs are known when the player is created. This skips source-setup,
+// typefinding, decodebin autoplugging and the multiqueues. A codec missing
+// from the table, or whose elements are not installed, is left to playbin.
+// COBALT_MEDIA_PIPELINE=playbin always uses playbin.
+class PipelineBuilder
+{
+public:
+  static bool IsEnabled();
+  // fills in |pipeline|, false when playbin has to be used
+  static bool Build(SbMediaVideoCodec video, SbMediaAudioCodec audio,
+                    PipelinePool::Pipeline* pipeline);
+  // registers the decoders with the source of a built pipeline and links
+  // their pads to the chains, before the pipeline leaves READY
+  static bool Link(const PipelinePool::Pipeline& pipeline,
+                   AbstractDecoder* audio, AbstractDecoder* video);
+  // parsers and decoders the table selects on this system
+  static std::vector<const char*> GetFactories();
+
+private:
+  PipelineBuilder() = delete;
+};
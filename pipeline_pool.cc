@@ -0,0 +1,269 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/pipeline_pool.h"
+#include "third_party/starboard/raspi/wayland/media_preload.h"
+#include "third_party/starboard/raspi/wayland/pipeline_builder.h"
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
+
+#include "starboard/thread.h"
+
+#include "base/logging.h"
+
+#include <cstdlib>
+
+namespace {
+
+// one pipeline per codec pair, the sinks hold hardware components
+const size_t kDefaultPoolSize = 1;
+
+size_t GetPoolSize()
+{
+  const char* value = getenv("COBALT_MEDIA_POOL_SIZE");
+  if (!value) {
+    return kDefaultPoolSize;
+  }
+  const long size = strtol(value, nullptr, 10);
+  return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+} // anonymous namespace
+
+// static
+PipelinePool& PipelinePool::Get()
+{
+  // never destroyed, the refill thread keeps running
+  static PipelinePool* pool = new PipelinePool();
+  return *pool;
+}
+
+PipelinePool::PipelinePool()
+  : Size(GetPoolSize()),
+  PlaybinFlags(MediaPreload::GetPlaybinFlags()),
+  Ready(),
+  Active(),
+  Pending(),
+  Counters(),
+  Wakeup()
+{
+  SbThreadCreate(0, kSbThreadPriorityLow, kSbThreadNoAffinity, false,
+                 "pipeline_pool", &PipelinePool::RefillThread, this);
+}
+
+void PipelinePool::Prewarm(SbMediaVideoCodec video, SbMediaAudioCodec audio)
+{
+  if (!Size) {
+    return;
+  }
+  {
+    starboard::ScopedLock lock(Mutex);
+    Ready[Key(video, audio)];
+  }
+  Wakeup.Put();
+}
+
+PipelinePool::Pipeline PipelinePool::Acquire(SbMediaVideoCodec video,
+                                             SbMediaAudioCodec audio)
+{
+  {
+    starboard::ScopedLock lock(Mutex);
+    ++Active[Key(video, audio)];
+    std::vector<Pipeline>& ready = Ready[Key(video, audio)];
+    if (!ready.empty()) {
+      const Pipeline pipeline = ready.back();
+      ready.pop_back();
+      ++Counters.Hits;
+      Wakeup.Put();
+      return pipeline;
+    }
+    ++Counters.Misses;
+  }
+  // the key is known now, the refill thread builds the next one
+  if (Size) {
+    Wakeup.Put();
+  }
+  return Build(Key(video, audio));
+}
+
+void PipelinePool::Release(SbMediaVideoCodec video, SbMediaAudioCodec audio,
+                           const Pipeline& pipeline)
+{
+  {
+    starboard::ScopedLock lock(Mutex);
+    --Active[Key(video, audio)];
+  }
+  if (!pipeline.Playbin) {
+    // the slot may be refilled now
+    Wakeup.Put();
+    return;
+  }
+  {
+    starboard::ScopedLock lock(Mutex);
+    Returned returned = { Key(video, audio), pipeline };
+    Pending.push_back(returned);
+  }
+  Wakeup.Put();
+}
+
+PipelinePool::Stats PipelinePool::GetStats() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return Counters;
+}
+
+// static
+void PipelinePool::SetMute(const Pipeline& pipeline, bool mute)
+{
+  GstElement* target = pipeline.Source ? pipeline.AudioSink : pipeline.Playbin;
+  if (g_object_class_find_property(G_OBJECT_GET_CLASS(target), "mute")) {
+    g_object_set(target, "mute", mute ? TRUE : FALSE, nullptr);
+  }
+}
+
+PipelinePool::Pipeline PipelinePool::Build(const Key& codecs) const
+{
+  Pipeline pipeline = Pipeline();
+  if (PipelineBuilder::Build(codecs.first, codecs.second, &pipeline)) {
+    return pipeline;
+  }
+  pipeline.Playbin = gst_element_factory_make("playbin", nullptr);
+  if (!pipeline.Playbin) {
+    SB_DLOG(ERROR) << "no playbin";
+    return pipeline;
+  }
+  g_object_set(pipeline.Playbin, "uri", "cobalt://", nullptr);
+  g_object_set(pipeline.Playbin, "flags", PlaybinFlags, nullptr);
+
+  const SinkProfile& profile = SinkProfile::Get();
+  pipeline.VideoSink = profile.CreateVideoSink();
+  g_object_set(pipeline.Playbin, "video-sink", pipeline.VideoSink, nullptr);
+  pipeline.AudioSink = profile.CreateAudioSink();
+  g_object_set(pipeline.Playbin, "audio-sink", pipeline.AudioSink, nullptr);
+  return pipeline;
+}
+
+bool PipelinePool::Rearm(const Pipeline& pipeline) const
+{
+  // messages of the previous player must not reach the next one
+  GstBus* bus = gst_element_get_bus(pipeline.Playbin);
+  gst_bus_set_flushing(bus, TRUE);
+  gst_bus_set_flushing(bus, FALSE);
+  gst_object_unref(bus);
+  SetMute(pipeline, false);
+  if (!SinkProfile::Get().IsHeadless()) {
+    g_object_set(G_OBJECT(pipeline.VideoSink), "zorder", 0.0f, nullptr);
+  }
+  return gst_element_set_state(pipeline.Playbin, GST_STATE_READY)
+    != GST_STATE_CHANGE_FAILURE;
+}
+
+// static
+void PipelinePool::Dispose(const Pipeline& pipeline)
+{
+  gst_element_set_state(pipeline.Playbin, GST_STATE_NULL);
+  gst_object_unref(pipeline.Playbin);
+}
+
+// static
+void* PipelinePool::RefillThread(void* data)
+{
+  reinterpret_cast<PipelinePool*>(data)->RefillLoop();
+  return nullptr;
+}
+
+void PipelinePool::RefillLoop()
+{
+  for (;;) {
+    Wakeup.Take();
+
+    std::vector<Returned> returned;
+    {
+      starboard::ScopedLock lock(Mutex);
+      returned.swap(Pending);
+    }
+    for (size_t i = 0; i < returned.size(); ++i) {
+      const Pipeline& pipeline = returned[i].Value;
+      bool wanted;
+      {
+        starboard::ScopedLock lock(Mutex);
+        wanted = Ready[returned[i].Codecs].size()
+          < GetTarget(returned[i].Codecs);
+      }
+      // only this thread adds pipelines, so the place is still free
+      bool kept = false;
+      if (wanted && Rearm(pipeline)) {
+        starboard::ScopedLock lock(Mutex);
+        Ready[returned[i].Codecs].push_back(pipeline);
+        ++Counters.Recycled;
+        kept = true;
+      }
+      if (!kept) {
+        Dispose(pipeline);
+        starboard::ScopedLock lock(Mutex);
+        ++Counters.Discarded;
+      }
+    }
+
+    Key key;
+    for (;;) {
+      {
+        starboard::ScopedLock lock(Mutex);
+        if (!FindIncomplete(&key)) {
+          break;
+        }
+      }
+      const Pipeline pipeline = Build(key);
+      if (!pipeline.Playbin
+          || gst_element_set_state(pipeline.Playbin, GST_STATE_READY)
+             == GST_STATE_CHANGE_FAILURE) {
+        SB_DLOG(ERROR) << "failed to prepare a pipeline";
+        if (pipeline.Playbin) {
+          Dispose(pipeline);
+        }
+        break;
+      }
+      starboard::ScopedLock lock(Mutex);
+      Ready[key].push_back(pipeline);
+    }
+  }
+}
+
+bool PipelinePool::FindIncomplete(Key* key) const
+{
+  size_t missing = 0;
+  for (auto i = Ready.begin(); i != Ready.end(); ++i) {
+    const size_t target = GetTarget(i->first);
+    if (i->second.size() < target && target - i->second.size() > missing) {
+      missing = target - i->second.size();
+      *key = i->first;
+    }
+  }
+  return missing > 0;
+}
+
+size_t PipelinePool::GetTarget(const Key& codecs) const
+{
+  // with a player active a second set of sinks would only sit in READY
+  const auto active = Active.find(codecs);
+  if (active != Active.end() && active->second > 0) {
+    return Size > 0 ? Size - 1 : 0;
+  }
+  return Size;
+}
@@ -0,0 +1,117 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/common/mutex.h"
+#include "starboard/common/semaphore.h"
+#include "starboard/media.h"
+
+#include <gst/gst.h>
+
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Pre-built pipelines with the sinks of the SinkProfile, waiting in READY,
+// so creating a player skips plugin instantiation and component setup.
+// Built by the PipelineBuilder, or playbin when it can't. Kept per codec
+// pair, a background thread builds new ones and
+// re-arms returned ones. COBALT_MEDIA_POOL_SIZE sets the pipelines kept per
+// codec pair, 0 builds every pipeline on demand. While a player of the pair
+// is active one pipeline less is kept, a READY pipeline holds its sinks'
+// hardware (the HDMI audio and video components on a Pi).
+class PipelinePool
+{
+public:
+  struct Pipeline
+  {
+    // owned, a playbin or a pipeline of the PipelineBuilder
+    GstElement* Playbin;
+    // owned by Playbin
+    GstElement* VideoSink;
+    GstElement* AudioSink;
+    // built pipelines only, owned by Playbin: cobaltsrc and the first
+    // element of each stream
+    GstElement* Source;
+    GstElement* VideoChain;
+    GstElement* AudioChain;
+  };
+
+  struct Stats
+  {
+    uint64_t Hits;
+    uint64_t Misses;
+    uint64_t Recycled;
+    uint64_t Discarded;
+  };
+
+  static PipelinePool& Get();
+
+  // builds pipelines for |video| and |audio| in the background
+  void Prewarm(SbMediaVideoCodec video, SbMediaAudioCodec audio);
+  // a pooled pipeline in READY, or a new one when none is left
+  Pipeline Acquire(SbMediaVideoCodec video, SbMediaAudioCodec audio);
+  // takes back a pipeline in NULL, stripped of all player handlers
+  void Release(SbMediaVideoCodec video, SbMediaAudioCodec audio,
+               const Pipeline& pipeline);
+
+  Stats GetStats() const;
+
+  // playbin mutes itself, otherwise the audio sink does if it can
+  static void SetMute(const Pipeline& pipeline, bool mute);
+
+private:
+  typedef std::pair<SbMediaVideoCodec, SbMediaAudioCodec> Key;
+
+  struct Returned
+  {
+    Key Codecs;
+    Pipeline Value;
+  };
+
+  PipelinePool();
+
+  Pipeline Build(const Key& codecs) const;
+  // brings a returned pipeline back to READY, false if it failed
+  bool Rearm(const Pipeline& pipeline) const;
+  static void Dispose(const Pipeline& pipeline);
+
+  static void* RefillThread(void* data);
+  void RefillLoop();
+  // locked, the key missing most pipelines, false if all are complete
+  bool FindIncomplete(Key* key) const;
+  // locked, pipelines to keep ready for |codecs|
+  size_t GetTarget(const Key& codecs) const;
+
+  const size_t Size;
+  const gint PlaybinFlags;
+  mutable starboard::Mutex Mutex;
+  std::map<Key, std::vector<Pipeline> > Ready;
+  // players holding a pipeline, per codec pair
+  std::map<Key, int> Active;
+  std::vector<Returned> Pending;
+  Stats Counters;
+  starboard::Semaphore Wakeup;
+
+  PipelinePool(const PipelinePool&) = delete;
+  PipelinePool& operator=(const PipelinePool&) = delete;
+};
@@ -242,19 +242,32 @@ void SbPlayerWriteSample2(
  const SbPlayerSampleInfo* sample_infos,
  int number_of_sample_infos)
 {
-  SB_DCHECK(number_of_sample_infos == 1);
-  const void* sample_buffers[] = {sample_infos->buffer};
-  const int sample_buffer_sizes[] = {sample_infos->buffer_size};
-  int number_of_sample_buffers = 1;
-  SbTime sample_timestamp = sample_infos->timestamp;
-  const SbMediaVideoSampleInfo*  video_sample_info = &sample_infos->video_sample_info;
-  const SbDrmSampleInfo* sample_drm_info = sample_infos->drm_info;
-  //SbMediaType sample_type = sample_infos->type;
-  player->WriteSample(sample_type, sample_buffers, sample_buffer_sizes,
-                      number_of_sample_buffers, sample_timestamp,
-                      video_sample_info, sample_drm_info);
+  SB_DCHECK(number_of_sample_infos <= SbPlayerPrivate::kMaxSamplesPerWrite);
+  if (number_of_sample_infos == 1) {
+    const void* sample_buffers[] = {sample_infos->buffer};
+    const int sample_buffer_sizes[] = {sample_infos->buffer_size};
+    int number_of_sample_buffers = 1;
+    SbTime sample_timestamp = sample_infos->timestamp;
+    const SbMediaVideoSampleInfo*  video_sample_info = &sample_infos->video_sample_info;
+    const SbDrmSampleInfo* sample_drm_info = sample_infos->drm_info;
+    //SbMediaType sample_type = sample_infos->type;
+    player->WriteSample(sample_type, sample_buffers, sample_buffer_sizes,
+                        number_of_sample_buffers, sample_timestamp,
+                        video_sample_info, sample_drm_info);
+    return;
+  }
+  player->WriteSamples(sample_type, sample_infos, number_of_sample_infos);
 }
 
+// Returns the number of samples the player accepts in a single
+// SbPlayerWriteSample2() call for the given |sample_type|.
+SB_EXPORT int SbPlayerGetMaximumNumberOfSamplesPerWrite(SbPlayer player,
+                                                        SbMediaType sample_type)
+{
+  SB_UNREFERENCED_PARAMETER(player);
+  SB_UNREFERENCED_PARAMETER(sample_type);
+  return SbPlayerPrivate::kMaxSamplesPerWrite;
+}
 
 // Writes a marker to |player|'s input stream of |stream_type| indicating that
 // there are no more samples for that media type for the remainder of this
@@ -352,8 +365,10 @@ SB_EXPORT bool SbMediaIsSupported(SbMediaVideoCodec videoCodec,
                                   SbMediaAudioCodec audioCodec,
                                   const char* keySystem)
 {
-  if (keySystem) {
-    SB_DLOG(INFO) << "pretending to support " << keySystem;
+  if (keySystem && *keySystem) {
+    // no DRM system on this platform
+    SB_DLOG(INFO) << "key system " << keySystem << " not supported";
+    return false;
   }
   int profile = -1;
   int level = -1;
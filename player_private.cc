@@ -23,6 +23,10 @@
 #include "third_party/starboard/raspi/wayland/audio_decoder.h"
 #include "third_party/starboard/raspi/wayland/video_decoder.h"
 #include "third_party/starboard/raspi/wayland/cobalt_source.h"
+#include "third_party/starboard/raspi/wayland/media_preload.h"
+#include "third_party/starboard/raspi/wayland/pipeline_builder.h"
+#include "third_party/starboard/raspi/wayland/sample_pool.h"
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
 
 //#include "westeros-sink.h"
 
@@ -31,7 +35,8 @@
 #include "base/logging.h"
 
 #include <cmath>
-#include <map>
+#include <cstdlib>
+#include <string>
 #include <algorithm>
 
 GST_DEBUG_CATEGORY_STATIC (COBALT_MEDIA_BACKEND);
@@ -39,6 +44,9 @@ GST_DEBUG_CATEGORY_STATIC (COBALT_MEDIA_BACKEND);
 
 namespace {
 
+// how often the extrapolated position is checked against the sinks
+const guint kPositionCorrectionSeconds = 1;
+
 SbTime GstTimeToSbTime(gint64 time)
 {
   return static_cast<SbTime>(time / 1000);
@@ -49,51 +57,48 @@ gint64 SbTimeToGstTime(SbTime time)
   return static_cast<gint64>(time * 1000);
 }
 
-std::map<std::string, gint> Flags;
+// above 2x the decoder can't keep up with every frame anymore
+const double kDefaultTrickPlayRate = 2.0;
 
-unsigned GetFlagValue(const std::string& name)
+double GetTrickPlayRate()
 {
-  auto i = Flags.find(name);
-  if (i != Flags.end()) {
-    return i->second;
-  }
-  static GFlagsClass* flagsClass
-    = static_cast<GFlagsClass*>(g_type_class_ref(g_type_from_name("GstPlayFlags")));
-  GFlagsValue* flag = g_flags_get_value_by_nick(flagsClass, name.c_str());
-  if (!flag) {
-    SB_DLOG(ERROR) << "no flag value for " << name;
-    return 0;
-  }
-  gint value = flag->value;
-  Flags.insert(std::map<std::string, gint>::value_type(name, value));
-  return value;
+  const char* value = getenv("COBALT_MEDIA_TRICKPLAY_RATE");
+  const double rate = value ? strtod(value, nullptr) : 0.0;
+  return rate > 0.0 ? rate : kDefaultTrickPlayRate;
 }
 
-void DoCall(void* data)
-{
-  std::unique_ptr<Call> call(reinterpret_cast<Call*>(data));
-  (*call)();
-}
+// by default half of the buffer budget Cobalt keeps for the stream may be
+// held in the pipeline, COBALT_MEDIA_INFLIGHT_KB sets it, 0 for no limit
+const int kInFlightShare = 2;
+// while playing, a sample held this long has most likely leaked
+const SbTime kStaleSampleAge = 30 * kSbTimeSecond;
 
-// adapter for SbCreateThread
-void* ThreadStarter(void* context)
+int64_t GetInFlightBudget(SbMediaType type, SbMediaVideoCodec codec)
 {
-  DoCall(context);
-  return nullptr;
+  const char* value = getenv("COBALT_MEDIA_INFLIGHT_KB");
+  if (value) {
+    const long kb = strtol(value, nullptr, 10);
+    return kb > 0 ? static_cast<int64_t>(kb) * 1024 : 0;
+  }
+  const int budget = type == kSbMediaTypeVideo
+    ? SbMediaGetVideoBufferBudget(codec, 1920, 1080, 8)
+    : SbMediaGetAudioBufferBudget();
+  return budget / kInFlightShare;
 }
 
-
-// adapter for GSourceFunc
-gboolean SafeCaller(gpointer userData)
+void LogInFlight(const char* name, const SamplePool::InFlight& inFlight)
 {
-  DoCall(userData);
-  return G_SOURCE_REMOVE;
+  SB_DLOG(INFO) << name << " samples in flight " << inFlight.Samples << " ("
+    << inFlight.Bytes << " bytes), peak " << inFlight.PeakSamples << " ("
+    << inFlight.PeakBytes << " bytes), oldest "
+    << inFlight.OldestAge / kSbTimeMillisecond << "ms";
 }
 
-//adapter for GDestroyNotify
-void DestroyBufferAdapter(gpointer data)
+PlayerCommand MakeCommand(PlayerCommand::Kind type)
 {
-  DoCall(data);
+  PlayerCommand command = PlayerCommand();
+  command.Type = type;
+  return command;
 }
 
 void DisplayGraph(GstBin* bin, const char* fileName)
@@ -101,6 +106,17 @@ void DisplayGraph(GstBin* bin, const char* fileName)
   GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(bin, GST_DEBUG_GRAPH_SHOW_ALL, fileName);
 }
 
+// create till preroll over all players, by the kind of pipeline
+LatencyHistogram& GetPrerollLatency(bool built)
+{
+  // never destroyed, like the pipeline pool
+  static LatencyHistogram* const builtLatency
+    = new LatencyHistogram("create_to_preroll_built");
+  static LatencyHistogram* const playbinLatency
+    = new LatencyHistogram("create_to_preroll_playbin");
+  return built ? *builtLatency : *playbinLatency;
+}
+
 } // anonymous namespace
 
 // here we do all the validation, as there might be no exceprions
@@ -115,7 +131,9 @@ SbPlayer SbPlayerPrivate::CreatePlayer(SbWindow window,
   SbPlayerOutputMode output_mode,
   SbDecodeTargetGraphicsContextProvider* context_provider)
 {
-  if (window == nullptr
+  MediaPreload::Wait();
+  // headless sinks need no window
+  if ((window == nullptr && !SinkProfile::Get().IsHeadless())
       || !SbPlayerPrivate::OutputModeSupported(output_mode, video_codec, drm_system)
       || false) {
     return kSbPlayerInvalid;
@@ -152,37 +170,68 @@ bool SbPlayerPrivate::OutputModeSupported(SbPlayerOutputMode outputMode,
 
 SbPlayerPrivate::~SbPlayerPrivate()
 {
+  // samples released by the teardown must not reach the decoders anymore
+  Samples->SetReleaseListener(nullptr, nullptr);
   gst_element_set_state(Playbin, GST_STATE_NULL);
-  if (PositionUpdateSource) {
-    g_source_destroy(PositionUpdateSource);
-    PositionUpdateSource = nullptr;
-  }
-  if (g_main_loop_is_running(WorkerLoop)) {
-    g_main_loop_quit(WorkerLoop);
-  }
-  if (g_main_loop_is_running(DefaultLoop)) {
-    g_main_loop_quit(DefaultLoop);
-  }
   SB_DLOG(INFO) << "destroying player " << this;
-
-  SbThreadJoin(WorkerThreadHandle, nullptr);
-  WorkerThreadHandle = kSbThreadInvalid;
-  SbThreadJoin(DefaultThreadHandle, nullptr);
-  DefaultThreadHandle = kSbThreadInvalid;
+  Reactor.RunSync(std::bind(&SbPlayerPrivate::DetachSources, this));
+  SB_DLOG(INFO) << Commands.GetCoalesced() << " commands coalesced";
+  const QosTracker::Stats qos = Qos.GetStats();
+  SB_DLOG(INFO) << "video frames rendered " << qos.RenderedFrames
+    << " dropped " << qos.DroppedFrames << " skipped "
+    << Video->GetSkippedFrames() << ", jitter decode " << qos.DecodeJitter
+    << "us (max " << qos.MaxDecodeJitter << "us) render "
+    << qos.RenderJitter << "us (max " << qos.MaxRenderJitter << "us)";
+  SB_DLOG(INFO) << CreateToPresent.ToString();
+  SB_DLOG(INFO) << SeekToPresent.ToString();
+  SB_DLOG(INFO) << RateChangeToEffect.ToString();
+  SB_DLOG(INFO) << Queues.ToString();
+  // no streaming thread is left to run the probes
+  Queues.Detach();
+  // compared with playbin by media_benchmark, see --playbin_baseline_ms
+  SB_DLOG(INFO) << GetPrerollLatency(Pipeline.Source != nullptr).ToString();
+  LogInFlight("audio", Samples->GetInFlight(kSbMediaTypeAudio));
+  LogInFlight("video", Samples->GetInFlight(kSbMediaTypeVideo));
+  if (Source && CobaltSourceIsConfigured(Source)) {
+    // stops the pad tasks still referring to the decoders
+    CobaltSourceUnregisterPlayer(Source, Audio.get(), Video.get());
+  }
   Audio.reset();
   Video.reset();
 //  g_free(WindowPosition);
-  gst_object_unref(Playbin);
-  g_main_loop_unref(WorkerLoop);
-  g_main_context_unref(WorkerContext);
-  g_main_loop_unref(DefaultLoop);
+  if (Source) {
+    gst_object_unref(Source);
+  }
+  if (FirstFrameProbe) {
+    GstPad* sinkPad = gst_element_get_static_pad(VideoSink, "sink");
+    gst_pad_remove_probe(sinkPad, FirstFrameProbe);
+    gst_object_unref(sinkPad);
+  }
+  if (SourceSetupHandler) {
+    g_signal_handler_disconnect(Playbin, SourceSetupHandler);
+  }
+  PipelinePool::Get().Release(VideoCodec, AudioCodec, Pipeline);
+  const PipelinePool::Stats pool = PipelinePool::Get().GetStats();
+  SB_DLOG(INFO) << "pipeline pool " << pool.Hits << " hits, " << pool.Misses
+    << " misses, " << pool.Recycled << " recycled, " << pool.Discarded
+    << " discarded";
+  const SamplePool::Stats stats = Samples->GetStats();
+  SB_DLOG(INFO) << "sample pool buffers " << stats.BufferHits << " hits, "
+    << stats.BufferMisses << " misses, memories " << stats.MemoryHits
+    << " hits, " << stats.MemoryMisses << " misses";
+  Samples->Release();
 }
 
 void SbPlayerPrivate::Seek(SbTime seekToPts, int ticket)
 {
+  // samples still queued belong to the old position
+  Audio->Flush();
+  Video->Flush();
+  PlayerCommand command = MakeCommand(PlayerCommand::kSeek);
   // convert micro seconds units to nano seconds
-  gint64 time = SbTimeToGstTime(seekToPts);
-  SafeCall(std::bind(&SbPlayerPrivate::DoSeek, this, time, ticket));
+  command.Time = SbTimeToGstTime(seekToPts);
+  command.Arguments[0] = ticket;
+  Post(command);
 }
 
 void SbPlayerPrivate::WriteSample(
@@ -202,72 +251,59 @@ void SbPlayerPrivate::WriteSample(
   if (number_of_sample_buffers <= 0) {
     return;
   }
-  GDestroyNotify deallocate = nullptr;
-  gpointer deallocateArgument = nullptr;
-  if (SampleDeallocateFunction) {
-    deallocate = DestroyBufferAdapter;
-    deallocateArgument = new Call(std::bind(SampleDeallocateFunction,
-                                            this,
-                                            StarboardContext,
-                                            sample_buffers[0]));
-  }
-
-  GstBuffer* const buffer
-    = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY,
-                                  const_cast<gpointer>(sample_buffers[0]),
-                                  sample_buffer_sizes[0],
-                                  0,
-                                  sample_buffer_sizes[0],
-                                  deallocateArgument,
-                                  deallocate);
-  for (int i = 1; i < number_of_sample_buffers; ++i) {
-    GstMemory* m
-      = gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
-                               const_cast<gpointer>(sample_buffers[i]),
-                               sample_buffer_sizes[i],
-                               0,
-                               sample_buffer_sizes[i],
-                               nullptr,
-                               nullptr); // tail freed when head is freed
-    gst_buffer_insert_memory(buffer, i, m);
+  AbstractDecoder* const decoder = GetDecoder(sample_type);
+  if (!decoder) {
+    return;
   }
+  GstBuffer* const buffer = Samples->Wrap(sample_type, sample_buffers,
+                                          sample_buffer_sizes,
+                                          number_of_sample_buffers);
 
   // convert micro seconds units to nano seconds
   GST_BUFFER_PTS(buffer) = SbTimeToGstTime(sample_pts);
 
-  AbstractDecoder* decoder = nullptr;
-  switch (sample_type) {
-  case kSbMediaTypeVideo:
-    decoder = Video.get();
-    break;
-  case kSbMediaTypeAudio:
-    decoder = Audio.get();
-    break;
-  default:
-    SB_DLOG(ERROR) << "strange buffer type " << sample_type;
-    gst_buffer_unref(buffer);
+  decoder->PrepareBuffer(buffer, sample_type == kSbMediaTypeVideo
+                                 ? video_sample_info : nullptr);
+  decoder->PushWorker(buffer);
+}
+
+void SbPlayerPrivate::WriteSamples(SbMediaType sample_type,
+                                   const SbPlayerSampleInfo* sample_infos,
+                                   int number_of_sample_infos)
+{
+  if (number_of_sample_infos <= 0) {
     return;
   }
-
-  decoder->PushWorker(buffer);
-//  SafeCall(std::bind(&AbstractDecoder::PushWorker, decoder, buffer));
+  AbstractDecoder* const decoder = GetDecoder(sample_type);
+  if (!decoder) {
+    return;
+  }
+  // the whole batch goes downstream in a single push. drm_info is ignored
+  // as in WriteSample, SbMediaIsSupported rejects every key system
+  GstBufferList* list = gst_buffer_list_new_sized(number_of_sample_infos);
+  for (int i = 0; i < number_of_sample_infos; ++i) {
+    const SbPlayerSampleInfo& info = sample_infos[i];
+    GstBuffer* const buffer
+      = Samples->Wrap(sample_type, &info.buffer, &info.buffer_size, 1);
+    GST_BUFFER_PTS(buffer) = SbTimeToGstTime(info.timestamp);
+    decoder->PrepareBuffer(buffer, sample_type == kSbMediaTypeVideo
+                                   ? &info.video_sample_info : nullptr);
+    if (decoder->HasCapsUpdate() && gst_buffer_list_length(list) > 0) {
+      // split the batch, new caps have to go in between
+      decoder->PushWorker(list, false);
+      list = gst_buffer_list_new_sized(number_of_sample_infos - i);
+    }
+    gst_buffer_list_add(list, buffer);
+  }
+  decoder->PushWorker(list);
 }
 
 void SbPlayerPrivate::WriteEndOfStream(SbMediaType streamType)
 {
-  AbstractDecoder* decoder;
-  switch (streamType) {
-  case kSbMediaTypeVideo:
-    decoder = Video.get();
-    break;
-  case kSbMediaTypeAudio:
-    decoder = Audio.get();
-    break;
-  default:
-    SB_DLOG(ERROR) << "strange stream type " << streamType;
-    return;
+  AbstractDecoder* const decoder = GetDecoder(streamType);
+  if (decoder) {
+    decoder->EosWorker();
   }
-  decoder->EosWorker();
 }
 
 void SbPlayerPrivate::SetBounds(int z_index,
@@ -275,14 +311,21 @@ void SbPlayerPrivate::SetBounds(int z_index,
 {
   // z_index seems to be just a counter, so ignore it
   SB_UNREFERENCED_PARAMETER(z_index);
-  SafeCall(std::bind(&SbPlayerPrivate::DoBounds, this,
-                     0, x, y, width, height));
+  PlayerCommand command = MakeCommand(PlayerCommand::kBounds);
+  command.Arguments[0] = 0;
+  command.Arguments[1] = x;
+  command.Arguments[2] = y;
+  command.Arguments[3] = width;
+  command.Arguments[4] = height;
+  Post(command);
 }
 
 bool SbPlayerPrivate::SetPlaybackRate(double newPlaybackRate)
 {
   if (newPlaybackRate >= 0.0) {
-    SafeCall(std::bind(&SbPlayerPrivate::DoPlaybackRate, this, newPlaybackRate));
+    PlayerCommand command = MakeCommand(PlayerCommand::kPlaybackRate);
+    command.Value = newPlaybackRate;
+    Post(command);
     return true;
   }
   return false;
@@ -291,13 +334,44 @@ bool SbPlayerPrivate::SetPlaybackRate(double newPlaybackRate)
 void SbPlayerPrivate::SetVolume(double volume)
 {
   if (volume >= 0.0 && volume <= 1.0) {
-    SafeCall(std::bind(&SbPlayerPrivate::DoVolume, this, volume));
+    PlayerCommand command = MakeCommand(PlayerCommand::kVolume);
+    command.Value = volume;
+    Post(command);
   }
 }
 
 void SbPlayerPrivate::GetInfo(SbPlayerInfo2* outPlayerInfo)
 {
   *outPlayerInfo = Info;
+  outPlayerInfo->current_media_timestamp = GetPosition();
+  const QosTracker::Stats stats = Qos.GetStats();
+  // delta frames skipped in trick play never reach the decoder
+  const int skipped = Video->GetSkippedFrames();
+  outPlayerInfo->dropped_video_frames
+    = static_cast<int>(stats.DroppedFrames) + skipped;
+  outPlayerInfo->corrupted_video_frames
+    = static_cast<int>(stats.CorruptedFrames);
+  if (stats.SinkReported) {
+    outPlayerInfo->total_video_frames = static_cast<int>(
+      stats.RenderedFrames + stats.DroppedFrames) + skipped;
+  }
+  else {
+    // the sink can't tell, every written frame is assumed to be shown
+    outPlayerInfo->total_video_frames = Video->GetWrittenFrames();
+  }
+}
+
+AbstractDecoder* SbPlayerPrivate::GetDecoder(SbMediaType type) const
+{
+  switch (type) {
+  case kSbMediaTypeVideo:
+    return Video.get();
+  case kSbMediaTypeAudio:
+    return Audio.get();
+  default:
+    SB_DLOG(ERROR) << "strange media type " << type;
+    return nullptr;
+  }
 }
 
 SbPlayerPrivate::SbPlayerPrivate(SbWindow window,
@@ -312,7 +386,7 @@ SbPlayerPrivate::SbPlayerPrivate(SbWindow window,
   void* context,
   SbPlayerOutputMode output_mode,
   SbDecodeTargetGraphicsContextProvider* context_provider)
-  : Window(*window),
+  : Window(window),
   VideoCodec(video_codec),
   AudioCodec(audio_codec),
   DurationPts(duration_pts),
@@ -323,30 +397,51 @@ SbPlayerPrivate::SbPlayerPrivate(SbWindow window,
   StarboardContext(context),
   OutputMode(output_mode),
   ContextProvider(context_provider),
+  Samples(SamplePool::Create(this, sample_deallocate_func, context)),
   Info(),
+  Qos(),
+  Queues(video_codec),
   PlayerState(kSbPlayerStateDestroyed), // error to be different from initial
   LastTicket(SB_PLAYER_INITIAL_TICKET),
-  DefaultLoop(g_main_loop_new(nullptr, true)),
-  WorkerContext(g_main_context_new()),
-  WorkerLoop(g_main_loop_new(WorkerContext, TRUE)),
-  Playbin(gst_element_factory_make("playbin", nullptr)),
+  Reactor(MediaReactor::Get()),
+  Pipeline(PipelinePool::Get().Acquire(video_codec, audio_codec)),
+  Playbin(Pipeline.Playbin),
+  Commands(),
+  BusWatch(nullptr),
+  SourceSetupHandler(0),
+  FirstFrameProbe(0),
   VideoSink(nullptr),
   AudioSink(nullptr),
   Source(nullptr),
   Audio(new AudioDecoder(*this, audio_header)),
   Video(new VideoDecoder(*this)),
-  DefaultThreadHandle(kSbThreadInvalid),
-  WorkerThreadHandle(kSbThreadInvalid),
   LastSeek(0),
+  TrickPlayRate(GetTrickPlayRate()),
+  TrickPlay(false),
 //  AudioReady(false),
 //  VideoReady(false)
 //  WindowPosition(nullptr)
-  PositionUpdateSource(nullptr),
+  PipelineReady(false),
+  Running(false),
+  EndOfStream(false),
+  Anchor(),
+  PositionCorrectionSource(nullptr),
   LastZ(-1),
   LastX(-1),
   LastY(-1),
   LastWidth(-1),
-  LastHeight(-1)
+  LastHeight(-1),
+  CreateTime(SbTimeGetMonotonicNow()),
+  Presented(false),
+  SeekStart(0),
+  SeekFlushTime(0),
+  RateChangeStart(0),
+  RateChangeState(GST_STATE_VOID_PENDING),
+  FirstFramePending(1),
+  StaleSamplesReported(false),
+  CreateToPresent("create_to_present"),
+  SeekToPresent("seek_to_present"),
+  RateChangeToEffect("rate_change_to_effect")
 {
   if (!SampleDeallocateFunction) {
     SB_DLOG(INFO) << "no sample deallocation function provided";
@@ -357,9 +452,12 @@ SbPlayerPrivate::SbPlayerPrivate(SbWindow window,
   if (!PlayerStatusFunction) {
     SB_DLOG(INFO) << "no player status function provided";
   }
-  SB_DCHECK(WorkerContext);
-  SB_DCHECK(WorkerLoop);
   SB_DCHECK(Playbin);
+  Samples->SetBudget(kSbMediaTypeAudio,
+                     GetInFlightBudget(kSbMediaTypeAudio, VideoCodec));
+  Samples->SetBudget(kSbMediaTypeVideo,
+                     GetInFlightBudget(kSbMediaTypeVideo, VideoCodec));
+  Samples->SetReleaseListener(&SbPlayerPrivate::OnSamplesReleased, this);
   SbPlayerInfo2 i = SbPlayerInfo2();
   i.is_paused = true;
   i.volume = 1.0;
@@ -375,114 +473,178 @@ bool SbPlayerPrivate::Initialize()
   GST_DEBUG_CATEGORY_INIT(COBALT_MEDIA_BACKEND, "COBALT_MEDIA_BACKEND", 0,
                           "Cobalt Gstreamer Media Playbin Backend");
 
-  //Build pipeline
-  g_signal_connect(Playbin, "source-setup",
-                   G_CALLBACK(SbPlayerPrivate::SourceChangedCallback), this);
-  g_object_set(Playbin, "uri", "cobalt://", nullptr);
-  const gint flags = GetFlagValue("video")
-    | GetFlagValue("audio")
-    | GetFlagValue("native-video")
-    | GetFlagValue("native-audio")
-    | GetFlagValue("buffering");
-  g_object_set(Playbin, "flags", flags, nullptr);
-
-  //video sink
-  VideoSink = gst_element_factory_make("westerossink", nullptr);
-  g_object_set(Playbin, "video-sink", VideoSink, nullptr);
-  g_object_set(G_OBJECT(VideoSink), "zorder", 0.0f, nullptr);
-
-  //audio sink
-  AudioSink = gst_element_factory_make("omxhdmiaudiosink", nullptr);
-  g_object_set(Playbin, "audio-sink", AudioSink, nullptr);
-  g_object_set(G_OBJECT(AudioSink), "async", true, nullptr);
-
-  gst_element_set_state(Playbin, GST_STATE_PAUSED);
+  // the pipeline and its sinks come prepared from the pool
+  if (!Pipeline.Source) {
+    Queues.Attach(Playbin);
+    SourceSetupHandler
+      = g_signal_connect(Playbin, "source-setup",
+                         G_CALLBACK(SbPlayerPrivate::SourceChangedCallback),
+                         this);
+  }
+  VideoSink = Pipeline.VideoSink;
+  AudioSink = Pipeline.AudioSink;
+  Qos.SetVideoSink(VideoSink);
+  GstPad* sinkPad = gst_element_get_static_pad(VideoSink, "sink");
+  if (sinkPad) {
+    FirstFrameProbe
+      = gst_pad_add_probe(sinkPad,
+                          static_cast<GstPadProbeType>(
+                            GST_PAD_PROBE_TYPE_BUFFER
+                            | GST_PAD_PROBE_TYPE_BUFFER_LIST
+                            | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+                          &SbPlayerPrivate::OnVideoSinkData, this, nullptr);
+    gst_object_unref(sinkPad);
+  }
 
   //Initialize A/V stream players
   if (!Video->Initialize() || !Audio->Initialize()) {
     return false;
   }
+  if (Pipeline.Source) {
+    // built for the codecs, the source is there and linked at once
+    Source = GST_ELEMENT(gst_object_ref(Pipeline.Source));
+    if (!PipelineBuilder::Link(Pipeline, Audio.get(), Video.get())) {
+      SB_DLOG(ERROR) << "failed to link the source";
+      return false;
+    }
+  }
+
+  gst_element_set_state(Playbin, GST_STATE_PAUSED);
 
-  starboard::Semaphore starter;
-  DefaultThreadHandle
-    = SbThreadCreate(0, kSbThreadPriorityRealTime, kSbThreadNoAffinity, true,
-                     "default", &ThreadStarter,
-                     new Call(std::bind(&SbPlayerPrivate::DefaultThread,
-                                        this)));
-  g_main_context_invoke(nullptr,
-    &SafeCaller,
-    reinterpret_cast<gpointer>(new Call(std::bind(&starboard::Semaphore::Put,
-                                                  &starter))));
-  starter.Take();
-  SB_DLOG(INFO) << "default loop started";
-
-  WorkerThreadHandle
-    = SbThreadCreate(0, kSbThreadPriorityRealTime, kSbThreadNoAffinity, true,
-                     "player", &ThreadStarter,
-                     new Call(std::bind(&SbPlayerPrivate::WorkerThread,
-                                        this)));
-  SafeCall(std::bind(&starboard::Semaphore::Put, &starter));
-  // wait till loop really started
-  starter.Take();
-  SB_DLOG(INFO) << "worker loop created " << this;
-  SafeCall(std::bind(&SbPlayerPrivate::ReportPlayerState, this,
-                     kSbPlayerStateInitialized));
+  // messages posted so far wait on the bus till the watch dispatches them
+  Commands.Attach(Reactor.GetContext(), &SbPlayerPrivate::HandleCommand,
+                  this);
+  GstBus* bus = gst_element_get_bus(Playbin);
+  BusWatch = gst_bus_create_watch(bus);
+  gst_object_unref(bus);
+  const GstBusFunc busCallback = &SbPlayerPrivate::GstBusCallback;
+  g_source_set_callback(BusWatch,
+                        reinterpret_cast<GSourceFunc>(G_CALLBACK(busCallback)),
+                        this, nullptr);
+  Reactor.Attach(BusWatch);
+  SB_DLOG(INFO) << "player attached to the media reactor " << this;
+  PlayerCommand command = MakeCommand(PlayerCommand::kPlayerState);
+  command.Arguments[0] = kSbPlayerStateInitialized;
+  Post(command);
+  if (Pipeline.Source) {
+    // with playbin once the source is set up
+    command.Arguments[0] = kSbPlayerStatePrerolling;
+    Post(command);
+  }
   return true;
 }
 
-void SbPlayerPrivate::DefaultThread()
+void SbPlayerPrivate::DetachSources()
 {
-  SB_DLOG(INFO) << "default loop started";
-  g_main_context_push_thread_default(nullptr);
-  g_main_loop_run(DefaultLoop);
-  SB_DLOG(INFO) << "default loop finished";
+  if (PositionCorrectionSource) {
+    g_source_destroy(PositionCorrectionSource);
+    g_source_unref(PositionCorrectionSource);
+    PositionCorrectionSource = nullptr;
+  }
+  if (BusWatch) {
+    g_source_destroy(BusWatch);
+    g_source_unref(BusWatch);
+    BusWatch = nullptr;
+  }
+  Commands.Detach();
+  ReportPlayerState(kSbPlayerStateDestroyed);
+  SB_DLOG(INFO) << "player detached from the media reactor " << this;
 }
 
-void SbPlayerPrivate::WorkerThread()
+void SbPlayerPrivate::Post(const PlayerCommand& command)
 {
-  SB_DLOG(INFO) << "worker loop started";
-
-  g_main_context_push_thread_default(WorkerContext);
-
-  GstBus* bus = gst_element_get_bus(Playbin);
-  gst_bus_add_watch(bus, SbPlayerPrivate::GstBusCallback, this);
-
-  g_main_loop_run(WorkerLoop);
+  Commands.Post(command);
+}
 
-  gst_bus_remove_watch(bus);
-  gst_object_unref(bus);
-  ReportPlayerState(kSbPlayerStateDestroyed);
-  // g_main_context_release(WorkerContext);
-  SB_DLOG(INFO) << "worker loop finished";
+// static
+void SbPlayerPrivate::HandleCommand(const PlayerCommand& command, void* data)
+{
+  reinterpret_cast<SbPlayerPrivate*>(data)->HandleCommand(command);
 }
 
-void SbPlayerPrivate::SafeCall(Call call)
+void SbPlayerPrivate::HandleCommand(const PlayerCommand& command)
 {
-  g_main_context_invoke(WorkerContext, &SafeCaller,
-                        reinterpret_cast<gpointer>(new Call(call)));
+  switch (command.Type) {
+  case PlayerCommand::kSeek:
+    SeekStart = command.Posted;
+    DoSeek(command.Time, command.Arguments[0]);
+    break;
+  case PlayerCommand::kBounds:
+    DoBounds(command.Arguments[0], command.Arguments[1], command.Arguments[2],
+             command.Arguments[3], command.Arguments[4]);
+    break;
+  case PlayerCommand::kPlaybackRate:
+    // before the first preroll the rate only applies with it, that is
+    // startup time, not the reaction to a rate change
+    RateChangeStart = PipelineReady ? command.Posted : 0;
+    DoPlaybackRate(command.Value);
+    break;
+  case PlayerCommand::kVolume:
+    DoVolume(command.Value);
+    break;
+  case PlayerCommand::kNeedsData:
+    {
+      AbstractDecoder* const decoder
+        = GetDecoder(static_cast<SbMediaType>(command.Arguments[0]));
+      if (decoder) {
+        decoder->DeliverNeedsData(command.Arguments[1]);
+      }
+      break;
+    }
+  case PlayerCommand::kPlayerState:
+    ReportPlayerState(static_cast<SbPlayerState>(command.Arguments[0]));
+    break;
+  case PlayerCommand::kSignal:
+    reinterpret_cast<starboard::Semaphore*>(command.Pointer)->Put();
+    break;
+  case PlayerCommand::kFirstFrame:
+    OnFirstFrame(command.Time);
+    break;
+  default:
+    SB_DLOG(ERROR) << "strange command " << command.Type;
+    break;
+  }
 }
 
 void SbPlayerPrivate::DoSeek(gint64 time, int newTicket)
 {
   LastTicket = newTicket;
+  EndOfStream = false;
   const double playbackRate = Info.Load().playback_rate;
   // if paused just store position for playback
-  if (playbackRate >= 1e-6 && PositionUpdateSource) {
-    DoSeekAndSpeed(time, playbackRate);
-    return;
+  if (playbackRate >= 1e-6 && PipelineReady) {
+    if (DoSeekAndSpeed(time, playbackRate)) {
+      // the source called OnSeek while gst_element_seek flushed it
+      return;
+    }
+  }
+  else {
+    // seek can't be done while paused. just record for the next play command
+    LastSeek = time;
+    SetAnchor(GstTimeToSbTime(time), 0.0);
+    // presenting waits for the user, not for the pipeline
+    SeekStart = 0;
   }
-  // seek can't be done while paused. just record for the next play command
-  LastSeek = time;
+  // no flushing seek reached the source, requests are allowed right away
+  Audio->SeekDone();
+  Video->SeekDone();
 }
 
 void SbPlayerPrivate::DoPlaybackRate(double newRate)
 {
-  if (PositionUpdateSource /*AudioReady && VideoReady*/) {
+  RateChangeState = newRate >= 1e-6 ? GST_STATE_PLAYING : GST_STATE_PAUSED;
+  if (PipelineReady /*AudioReady && VideoReady*/) {
     if (newRate >= 1e-6) {
       DoSeekAndSpeed(LastSeek, newRate);
       return;
     }
+    // freeze right away, the state change re-anchors once done
+    SetAnchor(GetPosition(), 0.0);
     gst_element_set_state(Playbin, GST_STATE_PAUSED);
+    if (!Running) {
+      // no state change to wait for
+      OnRateChangeEffect(GST_STATE_PAUSED);
+    }
     // fallthrough to record state
   }
   SbPlayerInfo2 i = Info;
@@ -496,16 +658,18 @@ void SbPlayerPrivate::DoPlaybackRate(double newRate)
   Info = i;
 }
 
-void SbPlayerPrivate::DoSeekAndSpeed(gint64 seekTo, double speedTo)
+bool SbPlayerPrivate::DoSeekAndSpeed(gint64 seekTo, double speedTo)
 {
   // here we sure that speedTo is not 0
   SB_DCHECK(speedTo >= 1e-6);
 
   SbPlayerInfo2 i = Info;
+  const SbTime current = GetPosition();
   gst_element_set_state(Playbin, GST_STATE_PLAYING);
+  bool flushed = false;
 
   if (fabs(speedTo - i.playback_rate) < 1e-6
-      && seekTo == 0 && i.current_media_timestamp == 0) {
+      && seekTo == 0 && current == 0) {
     // special case - avoid explicit seek at the beginning of playback
     SB_DLOG(INFO) << "skipped seek at the start of playback";
   }
@@ -517,31 +681,56 @@ void SbPlayerPrivate::DoSeekAndSpeed(gint64 seekTo, double speedTo)
     // newRate is always positive!
     gint64 position = seekTo;
     const bool isJump = position > 0
-      || (position == 0 && i.current_media_timestamp != 0);
+      || (position == 0 && current != 0);
     if (position >= 0) {
       // seek position is well known
       SB_DLOG(INFO) << "jumpimg to known time " << (position * 1e-9);
     }
-    else if (gst_element_query_position(Playbin, GST_FORMAT_TIME, &position)) {
-      SB_DLOG(INFO) << "successfully queried position " << (position * 1e-9);
-    }
     else {
-      position = SbTimeToGstTime(i.current_media_timestamp);
-      SB_DLOG(INFO) << "failed to query position. using last known "
-        << (position * 1e-9);
+      position = SbTimeToGstTime(current);
+      SB_DLOG(INFO) << "using extrapolated position " << (position * 1e-9);
+    }
+
+    // above the trick play rate decode key frames only and skip audio.
+    // delta frames are already dropped before cobaltsrc, the flags let the
+    // decoders and sinks know the segment is not continuous
+    const bool trickPlay = speedTo > TrickPlayRate;
+    int flags = isJump ? GST_SEEK_FLAG_FLUSH : GST_SEEK_FLAG_NONE;
+    if (trickPlay) {
+      flags |= GST_SEEK_FLAG_TRICKMODE | GST_SEEK_FLAG_TRICKMODE_KEY_UNITS
+        | GST_SEEK_FLAG_TRICKMODE_NO_AUDIO;
+    }
+    if (trickPlay != TrickPlay) {
+      SB_DLOG(INFO) << "trick play " << (trickPlay ? "on" : "off")
+        << " at rate " << speedTo;
+      TrickPlay = trickPlay;
+      Video->SetKeyFramesOnly(trickPlay);
+      PipelinePool::SetMute(Pipeline, trickPlay);
     }
 
     if (isJump) {
       ReportPlayerState(kSbPlayerStatePrerolling);
+      // the sink counters start over with the flush
+      Qos.OnFlush();
+      SeekFlushTime = SbTimeGetMonotonicNow();
+    }
+    const gboolean seeked
+      = gst_element_seek(Playbin,
+                         speedTo,
+                         GST_FORMAT_TIME,
+                         static_cast<GstSeekFlags>(flags),
+                         isJump ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
+                         isJump ? position : GST_CLOCK_TIME_NONE,
+                         GST_SEEK_TYPE_NONE,
+                         GST_CLOCK_TIME_NONE);
+    flushed = isJump && seeked;
+    // a jump holds still till prerolled at the target, see ASYNC_DONE
+    SetAnchor(GstTimeToSbTime(position),
+              !isJump && Running ? speedTo : 0.0);
+    if (!isJump && Running) {
+      // a rate change without flush applies with the new segment
+      OnRateChangeEffect(GST_STATE_PLAYING);
     }
-    gst_element_seek(Playbin,
-                     speedTo,
-                     GST_FORMAT_TIME,
-                     isJump ? GST_SEEK_FLAG_FLUSH : GST_SEEK_FLAG_NONE,
-                     isJump ? GST_SEEK_TYPE_SET : GST_SEEK_TYPE_NONE,
-                     isJump ? position : GST_CLOCK_TIME_NONE,
-                     GST_SEEK_TYPE_NONE,
-                     GST_CLOCK_TIME_NONE);
   }
 
   // update global data
@@ -549,11 +738,15 @@ void SbPlayerPrivate::DoSeekAndSpeed(gint64 seekTo, double speedTo)
   i.playback_rate = speedTo;
   i.is_paused = false;
   Info = i;
+  return flushed;
 }
 
 void SbPlayerPrivate::DoBounds(
   int z_index, int x, int y, int width, int height)
 {
+  if (SinkProfile::Get().IsHeadless()) {
+    return;
+  }
   // z_index from 0 till infinity?
   // z value from 0.0 to 1.0, internally only 100 layers? (0.00, 0.01 etc)
   // so converting 0->0.0, 1->1.5/100.0, infinity -> 1.0 using atan
@@ -600,6 +793,10 @@ void SbPlayerPrivate::GstBusCallback(GstMessage* message)
   case GST_MESSAGE_ASYNC_DONE:
     SB_DLOG(INFO) << "element " << GST_MESSAGE_SRC_NAME(message)
       << " GST_MESSAGE_ASYNC_DONE!";
+    if (GST_MESSAGE_SRC(message) == GST_OBJECT(Playbin)) {
+      // prerolled after a flushing seek, the segment is new
+      UpdateAnchor();
+    }
     break;
 
   case GST_MESSAGE_ERROR:
@@ -612,14 +809,22 @@ void SbPlayerPrivate::GstBusCallback(GstMessage* message)
     break;
 
   case GST_MESSAGE_WARNING:
+    Qos.OnWarningMessage(message);
     gst_message_parse_warning(message, &error, &debug);
     g_error_free(error);
     g_free(debug);
     SB_DLOG(ERROR) << "warning reported in callback";
     break;
 
+  case GST_MESSAGE_QOS:
+    Qos.OnQosMessage(message);
+    break;
+
   case GST_MESSAGE_EOS:
     GST_INFO("EOS reached pipeline");
+    // the last frame is shown, the position stays there till a seek
+    EndOfStream = true;
+    UpdateAnchor();
     ReportPlayerState(kSbPlayerStateEndOfStream);
     SB_DLOG(INFO) << "EOS reached pipeline";
     break;
@@ -637,12 +842,24 @@ void SbPlayerPrivate::GstBusCallback(GstMessage* message)
 
       GstObject* m = GST_MESSAGE_SRC(message);
       if (m == GST_OBJECT(Playbin)) {
-        if (newState == GST_STATE_PAUSED && !PositionUpdateSource) {
-          PositionUpdateSource = g_timeout_source_new(16);
-          g_source_attach(PositionUpdateSource, WorkerContext);
-          g_source_set_callback(PositionUpdateSource,
-                                &SbPlayerPrivate::UpdatePosition,
+        Running = newState == GST_STATE_PLAYING;
+        OnRateChangeEffect(newState);
+        if (newState == GST_STATE_PAUSED || newState == GST_STATE_PLAYING) {
+          UpdateAnchor();
+        }
+        if (newState == GST_STATE_PAUSED && !PipelineReady) {
+          PipelineReady = true;
+          const SbTime preroll = SbTimeGetMonotonicNow() - CreateTime;
+          GetPrerollLatency(Pipeline.Source != nullptr).Record(preroll);
+          SB_DLOG(INFO) << "prerolled " << preroll / kSbTimeMillisecond
+            << "ms after create, "
+            << (Pipeline.Source ? "built pipeline" : "playbin");
+          PositionCorrectionSource
+            = g_timeout_source_new_seconds(kPositionCorrectionSeconds);
+          g_source_set_callback(PositionCorrectionSource,
+                                &SbPlayerPrivate::CorrectPosition,
                                 this, nullptr);
+          Reactor.Attach(PositionCorrectionSource);
           ReportPlayerState(kSbPlayerStatePresenting);
           SbPlayerInfo2 i = Info;
           if (!i.is_paused) {
@@ -682,7 +899,6 @@ void SbPlayerPrivate::ReportPlayerState(SbPlayerState newState)
 {
   if (newState != PlayerState) {
     PlayerState = newState;
-#if 0
     std::string name;
     switch (PlayerState) {
 #define STATE_STRING(s) case s: name = #s; break;
@@ -698,8 +914,11 @@ void SbPlayerPrivate::ReportPlayerState(SbPlayerState newState)
         + std::to_string(static_cast<int>(PlayerState));
       break;
     }
-    SB_DLOG(INFO) << __func__ << " new state is " << name;
-#endif
+    const SbTime now = SbTimeGetMonotonicNow();
+    SB_DLOG(INFO) << __func__ << " new state is " << name << " after "
+      << (now - CreateTime) / kSbTimeMillisecond << "ms since create, "
+      << (SeekStart ? (now - SeekStart) / kSbTimeMillisecond : 0)
+      << "ms since seek";
   }
   if (PlayerStatusFunction) {
     PlayerStatusFunction(this, StarboardContext, newState, LastTicket);
@@ -712,27 +931,60 @@ void SbPlayerPrivate::SourceChangedCallback(GstElement* element,
                                             gpointer data)
 {
   SbPlayerPrivate& p = *reinterpret_cast<SbPlayerPrivate*>(data);
+  if (p.Source) {
+    gst_object_unref(p.Source);
+  }
   g_object_get(p.Playbin, "source", &p.Source, nullptr);
 }
 
-// static
-gboolean SbPlayerPrivate::UpdatePosition(gpointer data)
+SbTime SbPlayerPrivate::GetPosition() const
 {
-  SbPlayerPrivate& p = *reinterpret_cast<SbPlayerPrivate*>(data);
-  if (!p.VideoSink) {
-    return G_SOURCE_CONTINUE;
+  const PositionAnchor anchor = Anchor.Load();
+  if (anchor.Rate < 1e-6) {
+    return anchor.Position;
   }
+  const SbTime elapsed = SbTimeGetMonotonicNow() - anchor.Time;
+  return anchor.Position + static_cast<SbTime>(elapsed * anchor.Rate);
+}
 
-  gint64 pos = 0;
-  gst_element_query_position(p.Playbin, GST_FORMAT_TIME, &pos);
+void SbPlayerPrivate::SetAnchor(SbTime position, double rate)
+{
+  PositionAnchor anchor;
+  anchor.Position = position;
+  anchor.Time = SbTimeGetMonotonicNow();
+  anchor.Rate = EndOfStream ? 0.0 : rate;
+  Anchor = anchor;
+}
+
+void SbPlayerPrivate::UpdateAnchor()
+{
+  const double rate = Running ? Info.Load().playback_rate : 0.0;
+  gint64 position = 0;
+  // the sinks know best, the playbin query is only the fallback
+  if ((VideoSink
+       && gst_element_query_position(VideoSink, GST_FORMAT_TIME, &position))
+      || gst_element_query_position(Playbin, GST_FORMAT_TIME, &position)) {
+    SetAnchor(GstTimeToSbTime(position), rate);
+  }
+  else {
+    SetAnchor(GetPosition(), rate);
+  }
+}
 
-  SbPlayerInfo2 i = p.Info;
-  i.current_media_timestamp = GstTimeToSbTime(pos);
-  p.Info = i;
+// static
+gboolean SbPlayerPrivate::CorrectPosition(gpointer data)
+{
+  SbPlayerPrivate& p = *reinterpret_cast<SbPlayerPrivate*>(data);
+  // a paused position does not drift, nor are frames rendered
+  if (p.Running) {
+    p.UpdateAnchor();
+    p.Qos.PollSink();
+    p.CheckStaleSamples();
+  }
 
 #if 0
   static bool reported = false;
-  if (pos > 5000000000ll && !reported) {
+  if (p.GetPosition() > 5000000 && !reported) {
     DisplayGraph(GST_BIN(p.Playbin), "after5sec");
     reported = true;
   }
@@ -741,3 +993,81 @@ gboolean SbPlayerPrivate::UpdatePosition(gpointer data)
   return G_SOURCE_CONTINUE;
 }
 
+void SbPlayerPrivate::CheckStaleSamples()
+{
+  if (StaleSamplesReported) {
+    return;
+  }
+  const SbMediaType types[] = { kSbMediaTypeAudio, kSbMediaTypeVideo };
+  for (SbMediaType type : types) {
+    const SamplePool::InFlight inFlight = Samples->GetInFlight(type);
+    if (inFlight.OldestAge > kStaleSampleAge) {
+      SB_LOG(WARNING) << "a " << (type == kSbMediaTypeVideo ? "video" : "audio")
+        << " sample is held for " << inFlight.OldestAge / kSbTimeSecond
+        << "s, " << inFlight.Samples << " samples (" << inFlight.Bytes
+        << " bytes) in flight";
+      StaleSamplesReported = true;
+    }
+  }
+}
+
+// static
+void SbPlayerPrivate::OnSamplesReleased(SbMediaType type, void* data)
+{
+  AbstractDecoder* decoder
+    = reinterpret_cast<SbPlayerPrivate*>(data)->GetDecoder(type);
+  if (decoder) {
+    decoder->UpdateDemand();
+  }
+}
+
+SbPlayerPrivate::Latencies SbPlayerPrivate::GetLatencies() const
+{
+  Latencies latencies;
+  latencies.CreateToPresent = CreateToPresent.Get();
+  latencies.SeekToPresent = SeekToPresent.Get();
+  latencies.RateChangeToEffect = RateChangeToEffect.Get();
+  return latencies;
+}
+
+// static
+GstPadProbeReturn SbPlayerPrivate::OnVideoSinkData(GstPad*,
+                                                   GstPadProbeInfo* info,
+                                                   gpointer data)
+{
+  SbPlayerPrivate& p = *reinterpret_cast<SbPlayerPrivate*>(data);
+  if (GST_PAD_PROBE_INFO_TYPE(info)
+      & (GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST)) {
+    if (SbAtomicNoBarrier_Exchange(&p.FirstFramePending, 0)) {
+      PlayerCommand command = MakeCommand(PlayerCommand::kFirstFrame);
+      command.Time = SbTimeGetMonotonicNow();
+      p.Post(command);
+    }
+  }
+  else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info))
+           == GST_EVENT_FLUSH_STOP) {
+    SbAtomicNoBarrier_Store(&p.FirstFramePending, 1);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+void SbPlayerPrivate::OnFirstFrame(SbTime time)
+{
+  if (!Presented) {
+    Presented = true;
+    CreateToPresent.Record(time - CreateTime);
+  }
+  // a frame queued before the flush may report only now
+  if (SeekStart && time >= SeekFlushTime) {
+    SeekToPresent.Record(time - SeekStart);
+    SeekStart = 0;
+  }
+}
+
+void SbPlayerPrivate::OnRateChangeEffect(GstState state)
+{
+  if (RateChangeStart && state == RateChangeState) {
+    RateChangeToEffect.Record(SbTimeGetMonotonicNow() - RateChangeStart);
+    RateChangeStart = 0;
+  }
+}
@@ -21,6 +21,14 @@
 
 #pragma once
 
+#include "third_party/starboard/raspi/wayland/command_queue.h"
+#include "third_party/starboard/raspi/wayland/latency_histogram.h"
+#include "third_party/starboard/raspi/wayland/media_reactor.h"
+#include "third_party/starboard/raspi/wayland/pipeline_pool.h"
+#include "third_party/starboard/raspi/wayland/qos_tracker.h"
+#include "third_party/starboard/raspi/wayland/queue_limiter.h"
+#include "third_party/starboard/raspi/wayland/snapshot.h"
+
 #include "starboard/configuration.h"
 #include "starboard/player.h"
 #include "starboard/thread.h"
@@ -33,34 +41,8 @@
 #include <memory>
 #include <functional>
 
-typedef std::function<void()> Call;
 class AbstractDecoder;
-
-template <typename T>
-struct Atomic
-{
-  Atomic() { Value = T(); }
-  T Load() const {
-    starboard::ScopedLock lock(Mutex);
-    return Value;
-  }
-  operator T() const {
-    starboard::ScopedLock lock(Mutex);
-    return Value;
-  }
-  T operator =(T value) {
-    starboard::ScopedLock lock(Mutex);
-    Value = value;
-    return Value;
-  }
-
-private:
-  T Value;
-  mutable starboard::Mutex Mutex;
-
-  Atomic(const Atomic&) = delete;
-  Atomic& operator=(const Atomic&) = delete;
-};
+class SamplePool;
 
 // this came from cobalt, so following requested functionality
 class SbPlayerPrivate
@@ -94,6 +76,11 @@ public:
     const SbMediaVideoSampleInfo* video_sample_info,
     const SbDrmSampleInfo* sample_drm_info);
 
+  // batched variant, all samples of the batch are pushed at once
+  void WriteSamples(SbMediaType sample_type,
+                    const SbPlayerSampleInfo* sample_infos,
+                    int number_of_sample_infos);
+
   void WriteEndOfStream(SbMediaType stream_type);
   void SetBounds(int z_index, int x, int y, int width, int height);
   bool SetPlaybackRate(double playback_rate);
@@ -108,6 +95,30 @@ public:
   SbMediaAudioCodec GetAudioCodec() const {
     return AudioCodec;
   }
+  // frame and jitter statistics of the video path
+  QosTracker::Stats GetStats() const {
+    return Qos.GetStats();
+  }
+  // the cobaltsrc of the player, owned by it. with playbin nullptr till
+  // source-setup
+  GstElement* GetSource() const {
+    return Source;
+  }
+
+  struct Latencies
+  {
+    // SbPlayerCreate till the first frame reached the video sink
+    LatencyHistogram::Data CreateToPresent;
+    // Seek till the first frame at the new position
+    LatencyHistogram::Data SeekToPresent;
+    // SetPlaybackRate till the pipeline runs at the new rate
+    LatencyHistogram::Data RateChangeToEffect;
+  };
+  // any thread
+  Latencies GetLatencies() const;
+
+  // upper limit of samples accepted by one WriteSamples call
+  static const int kMaxSamplesPerWrite = 16;
 
 private:
   SbPlayerPrivate(SbWindow window,
@@ -126,15 +137,22 @@ private:
   // 2nd stage of constructor, as exceprions are not allowed
   bool Initialize();
 
-  void DefaultThread();
-  void WorkerThread();
+  AbstractDecoder* GetDecoder(SbMediaType type) const;
+
+  // media thread, after this no callback of the player runs anymore
+  void DetachSources();
 
   friend class AbstractDecoder;
-  void SafeCall(Call call);
+  // queues a command for the media thread, from any thread
+  void Post(const PlayerCommand& command);
+  static void HandleCommand(const PlayerCommand& command, void* data);
+  void HandleCommand(const PlayerCommand& command);
 
   void DoSeek(gint64 time, int newTicket);
   void DoPlaybackRate(double newRate);
-  void DoSeekAndSpeed(gint64 seekTo, double speedTo);
+  // true when a flushing seek reached the source, which then ends the
+  // decoders' seek itself
+  bool DoSeekAndSpeed(gint64 seekTo, double speedTo);
   void DoBounds(int z_index, int x, int y, int width, int height);
   void DoVolume(double volume);
 
@@ -148,7 +166,24 @@ private:
                                     GstElement* source,
                                     gpointer data);
 
-  static gboolean UpdatePosition(gpointer data);
+  // position extrapolated from the anchor, any thread
+  SbTime GetPosition() const;
+  // media thread. |rate| is 0 while the position is not advancing
+  void SetAnchor(SbTime position, double rate);
+  // re-anchors at the position reported by the sinks
+  void UpdateAnchor();
+  static gboolean CorrectPosition(gpointer data);
+  // media thread, warns about a sample the pipeline does not release
+  void CheckStaleSamples();
+  // a stream of the sample pool went below its budget, any thread
+  static void OnSamplesReleased(SbMediaType type, void* data);
+
+  // streaming thread, notices the first video buffer after a flush
+  static GstPadProbeReturn OnVideoSinkData(GstPad* pad, GstPadProbeInfo* info,
+                                           gpointer data);
+  void OnFirstFrame(SbTime time);
+  // completes a pending rate change, if it waited for |state|
+  void OnRateChangeEffect(GstState state);
 
 //  static void FirstVideoFrame(GstElement* object,
 //                              guint arg0,
@@ -156,7 +191,8 @@ private:
 //                              gpointer data);
 
   // constant parameters
-  SbWindowPrivate &Window;
+  // nullptr for headless sink profiles
+  SbWindowPrivate* const Window;
   const SbMediaVideoCodec VideoCodec;
   const SbMediaAudioCodec AudioCodec;
   const SbTime DurationPts;
@@ -168,16 +204,28 @@ private:
   const SbPlayerOutputMode OutputMode;
   SbDecodeTargetGraphicsContextProvider* const ContextProvider;
 
+  // recycled wrappers for the written samples
+  SamplePool* const Samples;
+
   // working parameters
-  Atomic<SbPlayerInfo2> Info;
+  // polled by Cobalt, written by the media thread
+  Snapshot<SbPlayerInfo2> Info;
+  QosTracker Qos;
+  // the queues of playbin, unused with built pipelines
+  QueueLimiter Queues;
   SbPlayerState PlayerState;
   int LastTicket;
 
   // GStreamer handles
-  GMainLoop* const DefaultLoop;
-  GMainContext* const WorkerContext;
-  GMainLoop* const WorkerLoop;
+  MediaReactor& Reactor;
+  // from the pool, returned on destroy
+  const PipelinePool::Pipeline Pipeline;
   GstElement* const Playbin;
+  CommandQueue Commands;
+  GSource* BusWatch;
+  // removed before the pipeline goes back to the pool
+  gulong SourceSetupHandler;
+  gulong FirstFrameProbe;
   // referenced, but not owned
   GstElement* VideoSink;
   GstElement* AudioSink;
@@ -186,14 +234,47 @@ private:
   std::unique_ptr<AbstractDecoder> Audio;
   std::unique_ptr<AbstractDecoder> Video;
 
-  SbThreadId DefaultThreadHandle;
-  SbThreadId WorkerThreadHandle;
   gint64 LastSeek;
-  GSource* PositionUpdateSource;
+  // rates above this only show key frames, without audio
+  const double TrickPlayRate;
+  bool TrickPlay;
+  // set once the pipeline prerolled for the first time
+  bool PipelineReady;
+  bool Running;
+  // media thread, set by EOS till the next seek, freezes the position
+  bool EndOfStream;
+
+  // media position at a known monotonic time, so GetInfo needs no query
+  struct PositionAnchor
+  {
+    SbTime Position;
+    SbTime Time;
+    double Rate;
+  };
+  Snapshot<PositionAnchor> Anchor;
+  // low frequency correction of the anchor against the sinks
+  GSource* PositionCorrectionSource;
   int LastZ;
   int LastX;
   int LastY;
   int LastWidth;
   int LastHeight;
 
+  // latency bookkeeping, media thread
+  const SbTime CreateTime;
+  bool Presented;
+  // 0 when no seek is waiting for its first frame
+  SbTime SeekStart;
+  // frames that reached the sink before the flush belong to the old position
+  SbTime SeekFlushTime;
+  // 0 when no rate change is waiting for the pipeline
+  SbTime RateChangeStart;
+  GstState RateChangeState;
+  // set by a flush, cleared by the first buffer after it
+  SbAtomic32 FirstFramePending;
+  // media thread, warned once about a sample held too long
+  bool StaleSamplesReported;
+  LatencyHistogram CreateToPresent;
+  LatencyHistogram SeekToPresent;
+  LatencyHistogram RateChangeToEffect;
 };
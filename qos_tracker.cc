@@ -0,0 +1,173 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/qos_tracker.h"
+
+#include <cstring>
+
+namespace {
+
+// weight of a new sample in the jitter average, 1/16
+const int kJitterAverageShift = 4;
+
+SbTime AbsoluteMicroseconds(gint64 jitter)
+{
+  return static_cast<SbTime>((jitter < 0 ? -jitter : jitter) / 1000);
+}
+
+void UpdateJitter(gint64 jitter, SbTime* average, SbTime* worst)
+{
+  const SbTime value = AbsoluteMicroseconds(jitter);
+  *average += (value - *average) >> kJitterAverageShift;
+  if (value > *worst) {
+    *worst = value;
+  }
+}
+
+} // anonymous namespace
+
+void QosTracker::Counter::Update(uint64_t value)
+{
+  // a smaller value means the element started over
+  Total += value >= Last ? value - Last : value;
+  Last = value;
+}
+
+QosTracker::QosTracker()
+  : VideoSink(nullptr),
+  SinkHasStats(false),
+  SinkRendered(),
+  SinkDropped(),
+  DecoderDropped(),
+  Current(),
+  Published()
+{
+}
+
+void QosTracker::SetVideoSink(GstElement* sink)
+{
+  VideoSink = sink;
+  SinkHasStats = sink
+    && g_object_class_find_property(G_OBJECT_GET_CLASS(sink), "stats");
+}
+
+void QosTracker::OnQosMessage(GstMessage* message)
+{
+  GstObject* const source = GST_MESSAGE_SRC(message);
+  const bool fromSink = VideoSink && source == GST_OBJECT(VideoSink);
+  if (!fromSink && !IsVideoDecoder(source)) {
+    return;
+  }
+
+  GstFormat format;
+  guint64 processed = 0;
+  guint64 dropped = 0;
+  gst_message_parse_qos_stats(message, &format, &processed, &dropped);
+  gint64 jitter = 0;
+  gdouble proportion = 1.0;
+  gint quality = 0;
+  gst_message_parse_qos_values(message, &jitter, &proportion, &quality);
+
+  const bool frames = format == GST_FORMAT_BUFFERS
+    || format == GST_FORMAT_DEFAULT;
+  if (fromSink) {
+    if (frames && !SinkHasStats) {
+      // processed counts rendered and dropped buffers
+      SinkRendered.Update(processed >= dropped ? processed - dropped : 0);
+      SinkDropped.Update(dropped);
+    }
+    UpdateJitter(jitter, &Current.RenderJitter, &Current.MaxRenderJitter);
+  }
+  else {
+    if (frames) {
+      DecoderDropped.Update(dropped);
+    }
+    UpdateJitter(jitter, &Current.DecodeJitter, &Current.MaxDecodeJitter);
+  }
+  Current.Proportion = proportion;
+  Publish();
+}
+
+void QosTracker::OnWarningMessage(GstMessage* message)
+{
+  if (!IsVideoDecoder(GST_MESSAGE_SRC(message))) {
+    return;
+  }
+  GError* error = nullptr;
+  gst_message_parse_warning(message, &error, nullptr);
+  // GstVideoDecoder warns about each frame it skips below max-errors
+  if (error && g_error_matches(error, GST_STREAM_ERROR,
+                               GST_STREAM_ERROR_DECODE)) {
+    ++Current.CorruptedFrames;
+    Publish();
+  }
+  if (error) {
+    g_error_free(error);
+  }
+}
+
+void QosTracker::PollSink()
+{
+  if (!SinkHasStats) {
+    return;
+  }
+  GstStructure* stats = nullptr;
+  g_object_get(VideoSink, "stats", &stats, nullptr);
+  if (!stats) {
+    return;
+  }
+  guint64 rendered = 0;
+  guint64 dropped = 0;
+  if (gst_structure_get_uint64(stats, "rendered", &rendered)
+      && gst_structure_get_uint64(stats, "dropped", &dropped)) {
+    SinkRendered.Update(rendered);
+    SinkDropped.Update(dropped);
+    Current.SinkReported = true;
+    Publish();
+  }
+  gst_structure_free(stats);
+}
+
+void QosTracker::OnFlush()
+{
+  PollSink();
+  SinkRendered.Last = 0;
+  SinkDropped.Last = 0;
+}
+
+bool QosTracker::IsVideoDecoder(GstObject* object) const
+{
+  if (!GST_IS_ELEMENT(object)) {
+    return false;
+  }
+  const gchar* klass = gst_element_class_get_metadata(
+    GST_ELEMENT_GET_CLASS(object), GST_ELEMENT_METADATA_KLASS);
+  return klass && strstr(klass, "Decoder") && strstr(klass, "Video");
+}
+
+void QosTracker::Publish()
+{
+  Current.RenderedFrames = SinkRendered.Total;
+  Current.DroppedFrames = SinkDropped.Total + DecoderDropped.Total;
+  if (SinkRendered.Total) {
+    Current.SinkReported = true;
+  }
+  Published = Current;
+}
@@ -0,0 +1,98 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "third_party/starboard/raspi/wayland/snapshot.h"
+
+#include "starboard/time.h"
+
+#include <gst/gst.h>
+
+#include <cstdint>
+
+// Collects video frame statistics from GST_MESSAGE_QOS of the decoders and
+// the video sink, and from the "stats" property of the sink. Decode errors
+// the video decoders tolerate arrive as warnings and count as corrupted.
+// Element counters restart on flushes, so only their increments are
+// accumulated. Fed on the media thread, the totals can be read from any
+// thread.
+class QosTracker
+{
+public:
+  struct Stats
+  {
+    // frames shown by the video sink
+    uint64_t RenderedFrames;
+    // frames dropped late, by a video decoder or the sink
+    uint64_t DroppedFrames;
+    // frames a video decoder failed to decode and skipped
+    uint64_t CorruptedFrames;
+    // average and worst absolute lateness reported by the decoders
+    SbTime DecodeJitter;
+    SbTime MaxDecodeJitter;
+    // the same for the video sink
+    SbTime RenderJitter;
+    SbTime MaxRenderJitter;
+    // last processing rate requested upstream, 1.0 is real time
+    double Proportion;
+    // the sink reported rendered frames, so the counts are complete
+    bool SinkReported;
+  };
+
+  QosTracker();
+
+  // not owned, has to outlive the tracker
+  void SetVideoSink(GstElement* sink);
+  void OnQosMessage(GstMessage* message);
+  // decoders report a frame they can't decode with a warning
+  void OnWarningMessage(GstMessage* message);
+  // reads the sink counters, for the frames rendered between drops
+  void PollSink();
+  // before a flushing seek, which restarts the sink counters
+  void OnFlush();
+
+  Stats GetStats() const {
+    return Published.Load();
+  }
+
+private:
+  // running total of a counter that restarts from 0 now and then
+  struct Counter
+  {
+    uint64_t Last;
+    uint64_t Total;
+    void Update(uint64_t value);
+  };
+
+  bool IsVideoDecoder(GstObject* object) const;
+  void Publish();
+
+  GstElement* VideoSink;
+  bool SinkHasStats;
+  Counter SinkRendered;
+  Counter SinkDropped;
+  Counter DecoderDropped;
+  Stats Current;
+  Snapshot<Stats> Published;
+
+  QosTracker(const QosTracker&) = delete;
+  QosTracker& operator=(const QosTracker&) = delete;
+};
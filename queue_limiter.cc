@@ -0,0 +1,311 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/queue_limiter.h"
+
+#include "base/logging.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+// the source buffers of Cobalt hold the media, the queues below cobaltsrc
+// only have to bridge the decoders, so they get a small share
+const int kBudgetShare = 8;
+// the resolution is not known when the player is created
+const int kDefaultWidth = 1920;
+const int kDefaultHeight = 1080;
+const int kDefaultBitsPerPixel = 8;
+
+const char* GetFactoryName(GstElement* element)
+{
+  GstElementFactory* factory = gst_element_get_factory(element);
+  return factory
+    ? gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory)) : nullptr;
+}
+
+void SetLimits(GstElement* element, int budget)
+{
+  // only the bytes count. time and buffers get the largest values rather
+  // than 0, which decodebin takes for its defaults: 5 buffers once prerolled
+  g_object_set(element, "max-size-bytes", static_cast<guint>(budget),
+               "max-size-buffers", G_MAXUINT,
+               "max-size-time", G_MAXUINT64, nullptr);
+}
+
+gsize GetSize(GstPadProbeInfo* info)
+{
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    return gst_buffer_get_size(GST_PAD_PROBE_INFO_BUFFER(info));
+  }
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    return gst_buffer_list_calculate_size(
+      GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+QueueLimiter::QueueLimiter(SbMediaVideoCodec videoCodec)
+  : VideoBudget(SbMediaGetVideoBufferBudget(videoCodec, kDefaultWidth,
+                  kDefaultHeight, kDefaultBitsPerPixel) / kBudgetShare),
+  AudioBudget(SbMediaGetAudioBufferBudget() / kBudgetShare),
+  Playbin(nullptr),
+  ElementAddedHandler(0),
+  Queues(),
+  Probes(),
+  PadHandlers()
+{
+}
+
+QueueLimiter::~QueueLimiter()
+{
+  Detach();
+}
+
+void QueueLimiter::Attach(GstElement* playbin)
+{
+  Playbin = GST_ELEMENT(gst_object_ref(playbin));
+  ElementAddedHandler
+    = g_signal_connect(Playbin, "deep-element-added",
+                       G_CALLBACK(&QueueLimiter::OnElementAdded), this);
+  // a playbin back from the pool still holds the queues of its last player
+  GstIterator* elements = gst_bin_iterate_recurse(GST_BIN(Playbin));
+  GValue item = G_VALUE_INIT;
+  while (gst_iterator_next(elements, &item) == GST_ITERATOR_OK) {
+    GstElement* element = GST_ELEMENT(g_value_get_object(&item));
+    const char* factory = GetFactoryName(element);
+    if (factory) {
+      Limit(element, factory);
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(elements);
+  SB_DLOG(INFO) << "queue budget video " << VideoBudget << " audio "
+    << AudioBudget << " bytes";
+}
+
+void QueueLimiter::Detach()
+{
+  if (!Playbin) {
+    return;
+  }
+  g_signal_handler_disconnect(Playbin, ElementAddedHandler);
+  gst_object_unref(Playbin);
+  Playbin = nullptr;
+  starboard::ScopedLock lock(Mutex);
+  for (const auto& handler : PadHandlers) {
+    g_signal_handler_disconnect(handler.first, handler.second);
+    gst_object_unref(handler.first);
+  }
+  PadHandlers.clear();
+  for (const Probe& probe : Probes) {
+    gst_pad_remove_probe(probe.Pad, probe.Id);
+    gst_object_unref(probe.Pad);
+  }
+  Probes.clear();
+  // the playbin may go back to the pool, its queues are not ours anymore
+  Queues.clear();
+}
+
+int QueueLimiter::GetQueuedBytes() const
+{
+  starboard::ScopedLock lock(Mutex);
+  int bytes = 0;
+  for (const auto& queue : Queues) {
+    bytes += std::max(0, SbAtomicNoBarrier_Load(&queue->Bytes));
+  }
+  return bytes;
+}
+
+std::string QueueLimiter::ToString() const
+{
+  std::ostringstream out;
+  out << "queued bytes";
+  starboard::ScopedLock lock(Mutex);
+  for (const auto& queue : Queues) {
+    out << ' ' << queue->Name << (queue->Audio ? " audio " : " video ")
+      << std::max(0, SbAtomicNoBarrier_Load(&queue->Bytes)) << " peak "
+      << SbAtomicNoBarrier_Load(&queue->Peak) << ',';
+  }
+  if (Queues.empty()) {
+    out << " none";
+  }
+  return out.str();
+}
+
+// static
+void QueueLimiter::OnElementAdded(GstBin*, GstBin*, GstElement* element,
+                                  gpointer data)
+{
+  const char* factory = GetFactoryName(element);
+  if (factory) {
+    reinterpret_cast<QueueLimiter*>(data)->Limit(element, factory);
+  }
+}
+
+void QueueLimiter::Limit(GstElement* element, const char* factory)
+{
+  if (!strcmp(factory, "decodebin")) {
+    // applied again to its multiqueue once the streams are exposed
+    SetLimits(element, VideoBudget);
+    return;
+  }
+  if (!strcmp(factory, "uridecodebin")) {
+    g_object_set(element, "buffer-size", VideoBudget + AudioBudget, nullptr);
+    return;
+  }
+  if (strcmp(factory, "multiqueue") && strcmp(factory, "queue2")) {
+    return;
+  }
+  // video till the caps tell otherwise
+  SetLimits(element, VideoBudget);
+
+  std::unique_ptr<Queue> created(new Queue());
+  Queue* queue = created.get();
+  queue->Owner = this;
+  queue->Element = element;
+  queue->Name = GST_ELEMENT_NAME(element);
+  queue->Audio = false;
+  std::vector<GstPad*> pads;
+  {
+    starboard::ScopedLock lock(Mutex);
+    Queues.push_back(std::move(created));
+    if (!strcmp(factory, "multiqueue")) {
+      // request pads, added with each stream
+      const gulong handler
+        = g_signal_connect(element, "pad-added",
+                           G_CALLBACK(&QueueLimiter::OnPadAdded), this);
+      PadHandlers.push_back(
+        std::make_pair(GST_ELEMENT(gst_object_ref(element)), handler));
+    }
+    GST_OBJECT_LOCK(element);
+    for (GList* l = element->pads; l; l = l->next) {
+      pads.push_back(GST_PAD(gst_object_ref(l->data)));
+    }
+    GST_OBJECT_UNLOCK(element);
+  }
+  for (GstPad* pad : pads) {
+    Watch(queue, pad);
+    gst_object_unref(pad);
+  }
+}
+
+void QueueLimiter::Resize(GstElement* element, int budget) const
+{
+  SetLimits(element, budget);
+  GstElement* parent = GST_ELEMENT(gst_element_get_parent(element));
+  if (!parent) {
+    return;
+  }
+  // decodebin sets its own limits on the multiqueue after prerolling
+  const char* factory = GetFactoryName(parent);
+  if (factory && !strcmp(factory, "decodebin")) {
+    SetLimits(parent, budget);
+  }
+  gst_object_unref(parent);
+}
+
+// static
+void QueueLimiter::OnPadAdded(GstElement* element, GstPad* pad, gpointer data)
+{
+  QueueLimiter& limiter = *reinterpret_cast<QueueLimiter*>(data);
+  Queue* queue = limiter.Find(element);
+  if (queue) {
+    limiter.Watch(queue, pad);
+  }
+}
+
+void QueueLimiter::Watch(Queue* queue, GstPad* pad)
+{
+  Probe probe;
+  probe.Pad = GST_PAD(gst_object_ref(pad));
+  if (GST_PAD_IS_SINK(pad)) {
+    probe.Id = gst_pad_add_probe(pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER
+                                   | GST_PAD_PROBE_TYPE_BUFFER_LIST
+                                   | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM
+                                   | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+      &QueueLimiter::OnSinkData, queue, nullptr);
+  }
+  else {
+    probe.Id = gst_pad_add_probe(pad,
+      static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER
+                                   | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      &QueueLimiter::OnSourceData, queue, nullptr);
+  }
+  starboard::ScopedLock lock(Mutex);
+  Probes.push_back(probe);
+}
+
+QueueLimiter::Queue* QueueLimiter::Find(GstElement* element) const
+{
+  starboard::ScopedLock lock(Mutex);
+  for (const auto& queue : Queues) {
+    if (queue->Element == element) {
+      return queue.get();
+    }
+  }
+  return nullptr;
+}
+
+// static
+GstPadProbeReturn QueueLimiter::OnSinkData(GstPad*, GstPadProbeInfo* info,
+                                           gpointer data)
+{
+  Queue* queue = reinterpret_cast<Queue*>(data);
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_BOTH) {
+    GstEvent* event = GST_PAD_PROBE_INFO_EVENT(info);
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP) {
+      SbAtomicNoBarrier_Store(&queue->Bytes, 0);
+    }
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS && !queue->Audio) {
+      GstCaps* caps = nullptr;
+      gst_event_parse_caps(event, &caps);
+      const GstStructure* s = caps ? gst_caps_get_structure(caps, 0) : nullptr;
+      if (s && g_str_has_prefix(gst_structure_get_name(s), "audio/")) {
+        queue->Audio = true;
+        queue->Owner->Resize(queue->Element, queue->Owner->AudioBudget);
+      }
+    }
+    return GST_PAD_PROBE_OK;
+  }
+  const SbAtomic32 bytes = SbAtomicNoBarrier_Increment(
+    &queue->Bytes, static_cast<SbAtomic32>(GetSize(info)));
+  // only for the report, a lost update does not matter
+  if (bytes > SbAtomicNoBarrier_Load(&queue->Peak)) {
+    SbAtomicNoBarrier_Store(&queue->Peak, bytes);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+// static
+GstPadProbeReturn QueueLimiter::OnSourceData(GstPad*, GstPadProbeInfo* info,
+                                             gpointer data)
+{
+  Queue* queue = reinterpret_cast<Queue*>(data);
+  SbAtomicNoBarrier_Increment(&queue->Bytes,
+                              -static_cast<SbAtomic32>(GetSize(info)));
+  return GST_PAD_PROBE_OK;
+}
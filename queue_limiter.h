@@ -0,0 +1,105 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+#include "starboard/common/mutex.h"
+#include "starboard/media.h"
+
+#include <gst/gst.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Bounds the queues playbin inserts below cobaltsrc (the multiqueue of each
+// decodebin, queue2 for buffering) by a memory budget of the player, a share
+// of SbMediaGetVideoBufferBudget and SbMediaGetAudioBufferBudget, instead of
+// their defaults of several seconds. The bytes each queue holds are counted
+// with pad probes. Pipelines of the PipelineBuilder have no such queues.
+class QueueLimiter
+{
+public:
+  explicit QueueLimiter(SbMediaVideoCodec videoCodec);
+  ~QueueLimiter();
+
+  // sizes the queues of |playbin| and those added from now on, before it
+  // leaves READY
+  void Attach(GstElement* playbin);
+  // stops counting and forgets the queues, with the pipeline in NULL
+  void Detach();
+
+  int GetVideoBudget() const {
+    return VideoBudget;
+  }
+  int GetAudioBudget() const {
+    return AudioBudget;
+  }
+  // bytes held by all queues
+  int GetQueuedBytes() const;
+  // per queue: bytes held now and at most
+  std::string ToString() const;
+
+private:
+  struct Queue
+  {
+    QueueLimiter* Owner;
+    GstElement* Element;
+    std::string Name;
+    bool Audio;
+    SbAtomic32 Bytes;
+    SbAtomic32 Peak;
+  };
+
+  struct Probe
+  {
+    GstPad* Pad;
+    gulong Id;
+  };
+
+  static void OnElementAdded(GstBin* bin, GstBin* subBin, GstElement* element,
+                             gpointer data);
+  static void OnPadAdded(GstElement* element, GstPad* pad, gpointer data);
+  static GstPadProbeReturn OnSinkData(GstPad* pad, GstPadProbeInfo* info,
+                                      gpointer data);
+  static GstPadProbeReturn OnSourceData(GstPad* pad, GstPadProbeInfo* info,
+                                        gpointer data);
+
+  void Limit(GstElement* element, const char* factory);
+  // |element| and its decodebin, when it is a multiqueue
+  void Resize(GstElement* element, int budget) const;
+  void Watch(Queue* queue, GstPad* pad);
+  Queue* Find(GstElement* element) const;
+
+  const int VideoBudget;
+  const int AudioBudget;
+  GstElement* Playbin;
+  gulong ElementAddedHandler;
+  mutable starboard::Mutex Mutex;
+  std::vector<std::unique_ptr<Queue> > Queues;
+  std::vector<Probe> Probes;
+  // pad-added of the multiqueues
+  std::vector<std::pair<GstElement*, gulong> > PadHandlers;
+
+  QueueLimiter(const QueueLimiter&) = delete;
+  QueueLimiter& operator=(const QueueLimiter&) = delete;
+};
@@ -0,0 +1,447 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/sample_pool.h"
+
+#include "base/logging.h"
+
+#include <algorithm>
+
+// one sample fragment, the deallocation context is part of the memory
+struct SampleMemory
+{
+  GstMemory Memory;
+  gpointer Data;
+  // head of the sample, null for tail fragments (freed with the head)
+  const void* Sample;
+  SbMediaType Type;
+  // head fragments, when the sample was written
+  SbTime WriteTime;
+  // free list, or in flight list of the written heads with Previous
+  SampleMemory* Next;
+  SampleMemory* Previous;
+};
+
+typedef struct _GstSampleAllocator
+{
+  GstAllocator parent;
+  SamplePool* pool;
+} GstSampleAllocator;
+
+typedef struct _GstSampleAllocatorClass
+{
+  GstAllocatorClass parentClass;
+} GstSampleAllocatorClass;
+
+G_DEFINE_TYPE(GstSampleAllocator, gst_sample_allocator, GST_TYPE_ALLOCATOR);
+
+namespace {
+
+const int kPreallocatedBuffers = 32;
+const int kPreallocatedMemories = 32;
+const size_t kMaxFreeBuffers = 128;
+const int kMaxFreeMemories = 256;
+
+GQuark PoolQuark()
+{
+  static GQuark quark = g_quark_from_static_string("cobalt-sample-pool");
+  return quark;
+}
+
+gpointer SampleMemoryMap(GstMemory* memory, gsize, GstMapFlags)
+{
+  return reinterpret_cast<SampleMemory*>(memory)->Data;
+}
+
+void SampleMemoryUnmap(GstMemory*)
+{
+}
+
+GstMemory* SampleMemoryShare(GstMemory* memory, gssize offset, gssize size)
+{
+  GstMemory* parent = memory->parent ? memory->parent : memory;
+  if (size == -1) {
+    size = memory->size - offset;
+  }
+  // sharing is rare (parsers splitting buffers), so plain wrapped memory
+  // keeping the pooled one alive is good enough
+  return gst_memory_new_wrapped(GST_MEMORY_FLAG_READONLY,
+                                reinterpret_cast<SampleMemory*>(memory)->Data,
+                                memory->maxsize,
+                                memory->offset + offset,
+                                size,
+                                gst_memory_ref(parent),
+                                reinterpret_cast<GDestroyNotify>(
+                                  gst_memory_unref));
+}
+
+gboolean RemoveMeta(GstBuffer*, GstMeta** meta, gpointer)
+{
+  *meta = nullptr;
+  return TRUE;
+}
+
+} // anonymous namespace
+
+// glue between GStreamer callbacks and the pool internals
+struct SamplePoolGlue
+{
+  static void Free(GstAllocator* allocator, GstMemory* memory)
+  {
+    reinterpret_cast<GstSampleAllocator*>(allocator)->pool->RecycleMemory(
+      reinterpret_cast<SampleMemory*>(memory));
+  }
+
+  static gboolean Dispose(GstMiniObject* object)
+  {
+    SamplePool* pool = reinterpret_cast<SamplePool*>(
+      gst_mini_object_get_qdata(object, PoolQuark()));
+    // returning FALSE keeps the shell alive for the next sample
+    return pool->RecycleBuffer(GST_BUFFER_CAST(object)) ? FALSE : TRUE;
+  }
+
+  static void Finalize(GObject* object)
+  {
+    delete reinterpret_cast<GstSampleAllocator*>(object)->pool;
+    G_OBJECT_CLASS(gst_sample_allocator_parent_class)->finalize(object);
+  }
+};
+
+static void gst_sample_allocator_class_init(GstSampleAllocatorClass* klass)
+{
+  G_OBJECT_CLASS(klass)->finalize = SamplePoolGlue::Finalize;
+  GST_ALLOCATOR_CLASS(klass)->alloc = nullptr;
+  GST_ALLOCATOR_CLASS(klass)->free = SamplePoolGlue::Free;
+}
+
+static void gst_sample_allocator_init(GstSampleAllocator* allocator)
+{
+  GstAllocator* a = GST_ALLOCATOR_CAST(allocator);
+  a->mem_type = "CobaltSample";
+  a->mem_map = SampleMemoryMap;
+  a->mem_unmap = SampleMemoryUnmap;
+  a->mem_share = SampleMemoryShare;
+  GST_OBJECT_FLAG_SET(allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+  allocator->pool = nullptr;
+}
+
+// static
+SamplePool* SamplePool::Create(SbPlayer player,
+                               SbPlayerDeallocateSampleFunc deallocate,
+                               void* context)
+{
+  return new SamplePool(player, deallocate, context);
+}
+
+SamplePool::SamplePool(SbPlayer player,
+                       SbPlayerDeallocateSampleFunc deallocate,
+                       void* context)
+  : Player(player),
+  DeallocateFunction(deallocate),
+  Context(context),
+  Allocator(GST_ALLOCATOR_CAST(gst_object_ref_sink(
+    g_object_new(gst_sample_allocator_get_type(), nullptr)))),
+  Closed(false),
+  FreeMemories(nullptr),
+  FreeMemoryCount(0),
+  Counters(),
+  Streams(),
+  Listener(nullptr),
+  ListenerData(nullptr)
+{
+  reinterpret_cast<GstSampleAllocator*>(Allocator)->pool = this;
+
+  FreeBuffers.reserve(kMaxFreeBuffers);
+  for (int i = 0; i < kPreallocatedBuffers; ++i) {
+    GstBuffer* buffer = gst_buffer_new();
+    GST_MINI_OBJECT_CAST(buffer)->dispose = SamplePoolGlue::Dispose;
+    gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(buffer), PoolQuark(),
+                              this, nullptr);
+    FreeBuffers.push_back(buffer);
+  }
+  for (int i = 0; i < kPreallocatedMemories; ++i) {
+    SampleMemory* memory = g_new0(SampleMemory, 1);
+    memory->Next = FreeMemories;
+    FreeMemories = memory;
+    ++FreeMemoryCount;
+  }
+}
+
+SamplePool::~SamplePool()
+{
+  SB_DCHECK(Closed);
+}
+
+void SamplePool::Release()
+{
+  std::vector<GstBuffer*> buffers;
+  SampleMemory* memories = nullptr;
+  {
+    starboard::ScopedLock lock(Mutex);
+    Closed = true;
+    buffers.swap(FreeBuffers);
+    memories = FreeMemories;
+    FreeMemories = nullptr;
+    FreeMemoryCount = 0;
+  }
+  for (GstBuffer* buffer : buffers) {
+    GST_MINI_OBJECT_CAST(buffer)->dispose = nullptr;
+    gst_buffer_unref(buffer);
+  }
+  while (memories) {
+    SampleMemory* next = memories->Next;
+    g_free(memories);
+    memories = next;
+  }
+  // samples still in flight keep the allocator, and so the pool, alive
+  gst_object_unref(Allocator);
+}
+
+GstBuffer* SamplePool::Wrap(SbMediaType type,
+                            const void* const* sampleBuffers,
+                            const int* sampleBufferSizes,
+                            int numberOfSampleBuffers)
+{
+  GstBuffer* const buffer = AcquireBuffer();
+  SampleMemory* head = nullptr;
+  int64_t bytes = 0;
+  for (int i = 0; i < numberOfSampleBuffers; ++i) {
+    SampleMemory* const memory = AcquireMemory();
+    gst_memory_init(&memory->Memory, GST_MEMORY_FLAG_READONLY, Allocator,
+                    nullptr, sampleBufferSizes[i], 0, 0,
+                    sampleBufferSizes[i]);
+    memory->Data = const_cast<gpointer>(sampleBuffers[i]);
+    memory->Sample = (i == 0) ? sampleBuffers[0] : nullptr;
+    memory->Type = type;
+    if (i == 0) {
+      head = memory;
+    }
+    bytes += sampleBufferSizes[i];
+    gst_buffer_append_memory(buffer, &memory->Memory);
+  }
+  if (head) {
+    starboard::ScopedLock lock(Mutex);
+    Track(head, bytes);
+  }
+  return buffer;
+}
+
+SamplePool::Stats SamplePool::GetStats() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return Counters;
+}
+
+SamplePool::InFlight SamplePool::GetInFlight(SbMediaType type) const
+{
+  starboard::ScopedLock lock(Mutex);
+  const Stream& stream = Streams[GetStreamIndex(type)];
+  InFlight counts = stream.Counts;
+  counts.OldestAge = stream.Oldest
+    ? SbTimeGetMonotonicNow() - stream.Oldest->WriteTime : 0;
+  return counts;
+}
+
+void SamplePool::SetBudget(SbMediaType type, int64_t bytes)
+{
+  starboard::ScopedLock lock(Mutex);
+  Streams[GetStreamIndex(type)].Budget = bytes;
+}
+
+bool SamplePool::IsOverBudget(SbMediaType type)
+{
+  starboard::ScopedLock lock(Mutex);
+  Stream& stream = Streams[GetStreamIndex(type)];
+  if (!stream.Budget || stream.Counts.Bytes < stream.Budget) {
+    return false;
+  }
+  stream.Blocked = true;
+  return true;
+}
+
+void SamplePool::SetReleaseListener(ReleaseFunc listener, void* data)
+{
+  starboard::ScopedLock lock(ListenerMutex);
+  Listener = listener;
+  ListenerData = data;
+}
+
+void SamplePool::Track(SampleMemory* head, int64_t bytes)
+{
+  Stream& stream = Streams[GetStreamIndex(head->Type)];
+  head->WriteTime = SbTimeGetMonotonicNow();
+  head->Previous = stream.Newest;
+  head->Next = nullptr;
+  if (stream.Newest) {
+    stream.Newest->Next = head;
+  }
+  else {
+    stream.Oldest = head;
+  }
+  stream.Newest = head;
+
+  InFlight& counts = stream.Counts;
+  ++counts.Samples;
+  counts.Bytes += bytes;
+  counts.PeakSamples = std::max(counts.PeakSamples, counts.Samples);
+  counts.PeakBytes = std::max(counts.PeakBytes, counts.Bytes);
+}
+
+bool SamplePool::Untrack(SampleMemory* memory)
+{
+  Stream& stream = Streams[GetStreamIndex(memory->Type)];
+  stream.Counts.Bytes -= memory->Memory.maxsize;
+  if (memory->Sample) {
+    // samples are released in any order, decoders reorder and hold some
+    if (memory->Previous) {
+      memory->Previous->Next = memory->Next;
+    }
+    else {
+      stream.Oldest = memory->Next;
+    }
+    if (memory->Next) {
+      memory->Next->Previous = memory->Previous;
+    }
+    else {
+      stream.Newest = memory->Previous;
+    }
+    memory->Next = nullptr;
+    memory->Previous = nullptr;
+    --stream.Counts.Samples;
+  }
+  if (stream.Blocked && stream.Counts.Bytes < stream.Budget) {
+    stream.Blocked = false;
+    return true;
+  }
+  return false;
+}
+
+GstBuffer* SamplePool::AcquireBuffer()
+{
+  GstBuffer* buffer = nullptr;
+  {
+    starboard::ScopedLock lock(Mutex);
+    if (!FreeBuffers.empty()) {
+      buffer = FreeBuffers.back();
+      FreeBuffers.pop_back();
+      ++Counters.BufferHits;
+    }
+    else {
+      ++Counters.BufferMisses;
+    }
+  }
+  if (!buffer) {
+    buffer = gst_buffer_new();
+    GST_MINI_OBJECT_CAST(buffer)->dispose = SamplePoolGlue::Dispose;
+    gst_mini_object_set_qdata(GST_MINI_OBJECT_CAST(buffer), PoolQuark(),
+                              this, nullptr);
+  }
+  // every buffer out in the pipeline holds the pool
+  gst_object_ref(Allocator);
+  return buffer;
+}
+
+SampleMemory* SamplePool::AcquireMemory()
+{
+  {
+    starboard::ScopedLock lock(Mutex);
+    if (FreeMemories) {
+      SampleMemory* memory = FreeMemories;
+      FreeMemories = memory->Next;
+      --FreeMemoryCount;
+      ++Counters.MemoryHits;
+      return memory;
+    }
+    ++Counters.MemoryMisses;
+  }
+  return g_new0(SampleMemory, 1);
+}
+
+bool SamplePool::RecycleBuffer(GstBuffer* buffer)
+{
+  bool keep;
+  {
+    starboard::ScopedLock lock(Mutex);
+    keep = !Closed && FreeBuffers.size() < kMaxFreeBuffers;
+  }
+  if (keep) {
+    // resurrect, so the shell is writable while being cleaned up
+    gst_buffer_ref(buffer);
+    gst_buffer_remove_all_memory(buffer);
+    gst_buffer_foreach_meta(buffer, RemoveMeta, nullptr);
+    GST_BUFFER_PTS(buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DTS(buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_DURATION(buffer) = GST_CLOCK_TIME_NONE;
+    GST_BUFFER_OFFSET(buffer) = GST_BUFFER_OFFSET_NONE;
+    GST_BUFFER_OFFSET_END(buffer) = GST_BUFFER_OFFSET_NONE;
+    GST_MINI_OBJECT_FLAGS(buffer) = 0;
+
+    bool closed;
+    {
+      starboard::ScopedLock lock(Mutex);
+      closed = Closed;
+      if (!closed) {
+        FreeBuffers.push_back(buffer);
+      }
+    }
+    if (closed) {
+      // released meanwhile, let the now empty shell go
+      GST_MINI_OBJECT_CAST(buffer)->dispose = nullptr;
+      gst_buffer_unref(buffer);
+    }
+  }
+  else {
+    GST_MINI_OBJECT_CAST(buffer)->dispose = nullptr;
+  }
+  // may drop the last reference to the pool
+  gst_object_unref(Allocator);
+  return keep;
+}
+
+void SamplePool::RecycleMemory(SampleMemory* memory)
+{
+  const SbMediaType type = memory->Type;
+  if (memory->Sample && DeallocateFunction) {
+    DeallocateFunction(Player, Context, memory->Sample);
+  }
+  bool belowBudget;
+  bool kept = false;
+  {
+    starboard::ScopedLock lock(Mutex);
+    belowBudget = Untrack(memory);
+    memory->Data = nullptr;
+    memory->Sample = nullptr;
+    if (!Closed && FreeMemoryCount < kMaxFreeMemories) {
+      memory->Next = FreeMemories;
+      FreeMemories = memory;
+      ++FreeMemoryCount;
+      kept = true;
+    }
+  }
+  if (!kept) {
+    g_free(memory);
+  }
+  if (belowBudget) {
+    starboard::ScopedLock lock(ListenerMutex);
+    if (Listener) {
+      Listener(type, ListenerData);
+    }
+  }
+}
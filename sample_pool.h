@@ -0,0 +1,148 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/common/mutex.h"
+#include "starboard/media.h"
+#include "starboard/player.h"
+#include "starboard/time.h"
+
+#include <gst/gst.h>
+
+#include <cstdint>
+#include <vector>
+
+struct SampleMemory;
+
+// Per player pool of GstBuffer and GstMemory shells wrapped around the sample
+// memory handed over by Cobalt. The deallocation context lives inside the
+// memory itself, so once the pool is warm WriteSample does no heap
+// allocation at all. Shells come back from the streaming threads when the
+// last reference is dropped downstream.
+//
+// The pool is kept alive by its GstAllocator, so samples still held by
+// GStreamer after the player is gone are released safely.
+//
+// Samples written but not yet released to Cobalt are accounted per stream,
+// wherever in the pipeline they are held. Above the budget of a stream the
+// decoder stops asking for data, and the release listener is told once the
+// stream is below it again.
+class SamplePool
+{
+public:
+  struct Stats
+  {
+    uint64_t BufferHits;
+    uint64_t BufferMisses;
+    uint64_t MemoryHits;
+    uint64_t MemoryMisses;
+  };
+
+  struct InFlight
+  {
+    int Samples;
+    int64_t Bytes;
+    int PeakSamples;
+    int64_t PeakBytes;
+    // of the oldest sample not released yet, 0 without any
+    SbTime OldestAge;
+  };
+
+  // any thread, a stream of the pool went below its budget
+  typedef void (*ReleaseFunc)(SbMediaType type, void* data);
+
+  static SamplePool* Create(SbPlayer player,
+                            SbPlayerDeallocateSampleFunc deallocate,
+                            void* context);
+
+  // drops the owner reference, pool goes away with the last sample
+  void Release();
+
+  // wraps the fragments of one sample into a single buffer
+  GstBuffer* Wrap(SbMediaType type,
+                  const void* const* sampleBuffers,
+                  const int* sampleBufferSizes,
+                  int numberOfSampleBuffers);
+
+  Stats GetStats() const;
+  InFlight GetInFlight(SbMediaType type) const;
+
+  // bytes in flight allowed for |type|, 0 for no limit
+  void SetBudget(SbMediaType type, int64_t bytes);
+  // the listener is called once the stream is below the budget again
+  bool IsOverBudget(SbMediaType type);
+  // nullptr to stop, returns once a running call is done
+  void SetReleaseListener(ReleaseFunc listener, void* data);
+
+private:
+  SamplePool(SbPlayer player,
+             SbPlayerDeallocateSampleFunc deallocate,
+             void* context);
+  ~SamplePool();
+  SamplePool(const SamplePool&) = delete;
+  SamplePool& operator=(const SamplePool&) = delete;
+
+  // in flight accounting of one stream
+  struct Stream
+  {
+    InFlight Counts;
+    // written samples, oldest first, linked by their head fragments
+    SampleMemory* Oldest;
+    SampleMemory* Newest;
+    int64_t Budget;
+    // IsOverBudget said so, the listener is due
+    bool Blocked;
+  };
+
+  static const int kStreamCount = 2;
+  static int GetStreamIndex(SbMediaType type) {
+    return type == kSbMediaTypeVideo ? 1 : 0;
+  }
+
+  GstBuffer* AcquireBuffer();
+  SampleMemory* AcquireMemory();
+  // locked
+  void Track(SampleMemory* head, int64_t bytes);
+  // locked, true when the stream went below its budget
+  bool Untrack(SampleMemory* memory);
+
+  friend struct SamplePoolGlue;
+  bool RecycleBuffer(GstBuffer* buffer);
+  void RecycleMemory(SampleMemory* memory);
+
+  const SbPlayer Player;
+  const SbPlayerDeallocateSampleFunc DeallocateFunction;
+  void* const Context;
+  GstAllocator* const Allocator;
+
+  mutable starboard::Mutex Mutex;
+  bool Closed;
+  std::vector<GstBuffer*> FreeBuffers;
+  SampleMemory* FreeMemories;
+  int FreeMemoryCount;
+  Stats Counters;
+  Stream Streams[kStreamCount];
+
+  // held while the listener runs, so it can be removed safely
+  starboard::Mutex ListenerMutex;
+  ReleaseFunc Listener;
+  void* ListenerData;
+};
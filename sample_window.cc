@@ -0,0 +1,211 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/sample_window.h"
+
+#include "base/logging.h"
+
+#include <cstdlib>
+
+namespace {
+
+// upper bound on retained samples, whatever the configured duration
+const size_t kMaxSamples = 2048;
+
+GstClockTime GetConfiguredDuration()
+{
+  const char* value = getenv("COBALT_MEDIA_RETAIN_MS");
+  if (!value) {
+    return 0;
+  }
+  const long ms = strtol(value, nullptr, 10);
+  return ms > 0 ? static_cast<GstClockTime>(ms) * GST_MSECOND : 0;
+}
+
+bool IsKeyFrame(GstBuffer* buffer)
+{
+  return !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+} // anonymous namespace
+
+SampleWindow::SampleWindow()
+  : MaxDuration(GetConfiguredDuration()),
+  MaxPts(GST_CLOCK_TIME_NONE),
+  ReplayPending(false),
+  ReplayFrom(0),
+  ReplayGeneration(0),
+  Dropping(false),
+  DropMatch(GST_CLOCK_TIME_NONE),
+  DropLimit(GST_CLOCK_TIME_NONE)
+{
+}
+
+SampleWindow::~SampleWindow()
+{
+  starboard::ScopedLock lock(Mutex);
+  ClearLocked();
+}
+
+void SampleWindow::Add(GstBuffer* buffer)
+{
+  const GstClockTime pts = GST_BUFFER_PTS(buffer);
+  if (!IsEnabled() || !GST_CLOCK_TIME_IS_VALID(pts)) {
+    return;
+  }
+  starboard::ScopedLock lock(Mutex);
+  if (Buffers.empty() && !IsKeyFrame(buffer)) {
+    // nothing to decode from yet
+    return;
+  }
+  Buffers.push_back(gst_buffer_ref(buffer));
+  if (!GST_CLOCK_TIME_IS_VALID(MaxPts) || pts > MaxPts) {
+    MaxPts = pts;
+  }
+
+  // drop whole groups of pictures from the front, the one still being
+  // filled stays even when it is longer than the window
+  while (Buffers.size() > kMaxSamples
+         || MaxPts - GST_BUFFER_PTS(Buffers.front()) > MaxDuration) {
+    size_t next = 1;
+    while (next < Buffers.size() && !IsKeyFrame(Buffers[next])) {
+      ++next;
+    }
+    if (next == Buffers.size()) {
+      if (Buffers.size() > kMaxSamples) {
+        // a single group can't be held, start over at the next key frame
+        ClearLocked();
+      }
+      break;
+    }
+    for (size_t i = 0; i < next; ++i) {
+      gst_buffer_unref(Buffers.front());
+      Buffers.pop_front();
+    }
+    ReplayFrom = ReplayFrom > next ? ReplayFrom - next : 0;
+  }
+}
+
+void SampleWindow::Clear()
+{
+  starboard::ScopedLock lock(Mutex);
+  ClearLocked();
+}
+
+bool SampleWindow::PrepareReplay(GstClockTime position,
+                                 SbAtomic32 generation,
+                                 GstClockTime* first,
+                                 GstClockTime* last)
+{
+  if (!IsEnabled()) {
+    return false;
+  }
+  starboard::ScopedLock lock(Mutex);
+  size_t from = Buffers.size();
+  if (GST_CLOCK_TIME_IS_VALID(MaxPts) && position <= MaxPts) {
+    for (size_t i = 0; i < Buffers.size(); ++i) {
+      const GstClockTime pts = GST_BUFFER_PTS(Buffers[i]);
+      if (pts > position) {
+        // samples are in decode order, so only key frames are conclusive
+        if (IsKeyFrame(Buffers[i])) {
+          break;
+        }
+        continue;
+      }
+      if (IsKeyFrame(Buffers[i])) {
+        from = i;
+      }
+    }
+  }
+  if (from == Buffers.size()) {
+    // whatever comes next is not contiguous with the window
+    ClearLocked();
+    return false;
+  }
+  ReplayPending = true;
+  ReplayFrom = from;
+  ReplayGeneration = generation;
+  Dropping = true;
+  DropMatch = GST_BUFFER_PTS(Buffers.back());
+  DropLimit = MaxPts;
+  *first = GST_BUFFER_PTS(Buffers[from]);
+  *last = MaxPts;
+  SB_DLOG(INFO) << "seek to " << (position * 1e-9) << " served from "
+    << (*first * 1e-9) << " - " << (*last * 1e-9) << ", "
+    << (Buffers.size() - from) << " samples";
+  return true;
+}
+
+bool SampleWindow::HasReplay() const
+{
+  starboard::ScopedLock lock(Mutex);
+  return ReplayPending;
+}
+
+void SampleWindow::TakeReplay(SbAtomic32 generation,
+                              std::vector<GstBuffer*>* buffers)
+{
+  starboard::ScopedLock lock(Mutex);
+  if (!ReplayPending) {
+    return;
+  }
+  ReplayPending = false;
+  if (generation != ReplayGeneration) {
+    // Cobalt seeks elsewhere, nothing it sends is a repeat of the window
+    Dropping = false;
+    return;
+  }
+  buffers->reserve(Buffers.size() - ReplayFrom);
+  for (size_t i = ReplayFrom; i < Buffers.size(); ++i) {
+    buffers->push_back(gst_buffer_ref(Buffers[i]));
+  }
+}
+
+bool SampleWindow::IsDuplicate(GstBuffer* buffer)
+{
+  starboard::ScopedLock lock(Mutex);
+  if (!Dropping) {
+    return false;
+  }
+  const GstClockTime pts = GST_BUFFER_PTS(buffer);
+  if (pts == DropMatch) {
+    // the last retained sample, the stream continues with the next one
+    Dropping = false;
+    return true;
+  }
+  if (GST_CLOCK_TIME_IS_VALID(pts) && pts > DropLimit) {
+    // never saw the match (nothing was resent), but this is new data anyway
+    Dropping = false;
+    return false;
+  }
+  return true;
+}
+
+void SampleWindow::ClearLocked()
+{
+  for (GstBuffer* buffer : Buffers) {
+    gst_buffer_unref(buffer);
+  }
+  Buffers.clear();
+  MaxPts = GST_CLOCK_TIME_NONE;
+  ReplayPending = false;
+  ReplayFrom = 0;
+  Dropping = false;
+}
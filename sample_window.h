@@ -0,0 +1,87 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+#include "starboard/common/mutex.h"
+#include "starboard/time.h"
+
+#include <gst/gst.h>
+
+#include <deque>
+#include <vector>
+
+// Window of the samples most recently pushed downstream, in decode order and
+// always starting with a key frame. A seek landing inside the window is
+// served by pushing the retained samples again from the preceding key frame,
+// the copies Cobalt sends after the seek are then dropped till the stream
+// continues past the window.
+//
+// Retained samples keep their Cobalt memory, so the window is off unless
+// COBALT_MEDIA_RETAIN_MS gives its length.
+class SampleWindow
+{
+public:
+  SampleWindow();
+  ~SampleWindow();
+
+  bool IsEnabled() const {
+    return MaxDuration > 0;
+  }
+
+  // pad task, |buffer| is about to be delivered. the window takes a ref
+  void Add(GstBuffer* buffer);
+  // the stream is not contiguous any more (new caps)
+  void Clear();
+
+  // seek thread. returns true when |position| can be served locally, in
+  // which case |first| and |last| give the replayed pts range. the replay
+  // belongs to the writes of |generation|
+  bool PrepareReplay(GstClockTime position, SbAtomic32 generation,
+                     GstClockTime* first,
+                     GstClockTime* last);
+  bool HasReplay() const;
+  // pad task, returns referenced buffers to be pushed again. nothing once
+  // the writes moved on to another |generation|, a seek came in between
+  void TakeReplay(SbAtomic32 generation, std::vector<GstBuffer*>* buffers);
+  // pad task, true when |buffer| was already replayed
+  bool IsDuplicate(GstBuffer* buffer);
+
+private:
+  void ClearLocked();
+
+  const GstClockTime MaxDuration;
+
+  mutable starboard::Mutex Mutex;
+  std::deque<GstBuffer*> Buffers;
+  GstClockTime MaxPts;
+  bool ReplayPending;
+  size_t ReplayFrom;
+  SbAtomic32 ReplayGeneration;
+  // dropping repeated samples, till the one with |DropMatch| or one past
+  // |DropLimit|
+  bool Dropping;
+  GstClockTime DropMatch;
+  GstClockTime DropLimit;
+
+  SampleWindow(const SampleWindow&) = delete;
+  SampleWindow& operator=(const SampleWindow&) = delete;
+};
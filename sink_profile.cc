@@ -0,0 +1,226 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "third_party/starboard/raspi/wayland/sink_profile.h"
+
+#include "starboard/shared/starboard/command_line.h"
+
+#include "base/logging.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+const char kSwitch[] = "media_sink_profile";
+
+// what the decoders set on cobaltsrc, for the passthrough sinks
+const char kEncodedCaps[] =
+  "video/x-h264; video/x-mpeg; video/x-vc1; video/x-vp8; audio/mpeg";
+
+bool IsHardwareDecoder(GstElementFactory* factory)
+{
+  const gchar* klass = gst_element_factory_get_metadata(
+    factory, GST_ELEMENT_METADATA_KLASS);
+  const gchar* name = gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+  return (klass && strstr(klass, "Hardware"))
+    || g_str_has_prefix(name, "omx") || g_str_has_prefix(name, "v4l2");
+}
+
+} // anonymous namespace
+
+SinkProfile::SinkProfile()
+  : Type(kDevice),
+  Sync(true),
+  SoftwareDecoders(false),
+  Passthrough(false)
+{
+}
+
+// static
+SinkProfile& SinkProfile::Selected()
+{
+  static SinkProfile profile = Parse(getenv("COBALT_MEDIA_SINK_PROFILE"));
+  return profile;
+}
+
+// static
+const SinkProfile& SinkProfile::Get()
+{
+  return Selected();
+}
+
+// static
+void SinkProfile::Configure(int argc, char** argv)
+{
+  starboard::shared::starboard::CommandLine commandLine(argc, argv);
+  if (commandLine.HasSwitch(kSwitch)) {
+    Selected() = Parse(commandLine.GetSwitchValue(kSwitch).c_str());
+  }
+  const SinkProfile& profile = Selected();
+  if (profile.SoftwareDecoders) {
+    profile.DemoteHardwareDecoders();
+  }
+  SB_LOG(INFO) << "media sink profile " << profile.ToString();
+}
+
+// static
+SinkProfile SinkProfile::Parse(const char* description)
+{
+  SinkProfile profile;
+  if (!description || !*description) {
+    return profile;
+  }
+  bool softwareSet = false;
+  std::istringstream tokens(description);
+  std::string token;
+  while (std::getline(tokens, token, ',')) {
+    if (token == "device") {
+      profile.Type = kDevice;
+    }
+    else if (token == "fakesink") {
+      profile.Type = kFakeSink;
+    }
+    else if (token == "appsink") {
+      profile.Type = kAppSink;
+    }
+    else if (token == "sync" || token == "nosync") {
+      profile.Sync = token == "sync";
+    }
+    else if (token == "software" || token == "hardware") {
+      profile.SoftwareDecoders = token == "software";
+      softwareSet = true;
+    }
+    else if (token == "passthrough") {
+      profile.Passthrough = true;
+    }
+    else {
+      SB_LOG(WARNING) << "unknown media sink profile option " << token;
+    }
+  }
+  if (!softwareSet) {
+    // without the Pi there are no hardware decoders
+    profile.SoftwareDecoders = profile.IsHeadless();
+  }
+  if (profile.Passthrough && profile.Type != kAppSink) {
+    SB_LOG(WARNING) << "passthrough needs appsink, ignored";
+    profile.Passthrough = false;
+  }
+  return profile;
+}
+
+const char* SinkProfile::GetVideoSinkName() const
+{
+  switch (Type) {
+  case kFakeSink:
+    return "fakesink";
+  case kAppSink:
+    return "appsink";
+  default:
+    return "westerossink";
+  }
+}
+
+const char* SinkProfile::GetAudioSinkName() const
+{
+  return IsHeadless() ? GetVideoSinkName() : "omxhdmiaudiosink";
+}
+
+GstElement* SinkProfile::CreateVideoSink() const
+{
+  if (IsHeadless()) {
+    return CreateHeadlessSink(GetVideoSinkName());
+  }
+  GstElement* sink = gst_element_factory_make(GetVideoSinkName(), nullptr);
+  g_object_set(G_OBJECT(sink), "zorder", 0.0f, nullptr);
+  return sink;
+}
+
+GstElement* SinkProfile::CreateAudioSink() const
+{
+  GstElement* sink = IsHeadless()
+    ? CreateHeadlessSink(GetAudioSinkName())
+    : gst_element_factory_make(GetAudioSinkName(), nullptr);
+  g_object_set(G_OBJECT(sink), "async", true, nullptr);
+  return sink;
+}
+
+GstElement* SinkProfile::CreateHeadlessSink(const char* name) const
+{
+  GstElement* sink = gst_element_factory_make(name, nullptr);
+  if (!sink) {
+    return nullptr;
+  }
+  // qos makes the sink report lateness and drops, as the device sinks do
+  g_object_set(G_OBJECT(sink), "sync", Sync ? TRUE : FALSE,
+               "qos", Sync ? TRUE : FALSE, nullptr);
+  if (Type == kAppSink) {
+    // nobody pulls, keep only the last frame
+    g_object_set(G_OBJECT(sink), "max-buffers", 1u, "drop", TRUE, nullptr);
+  }
+  if (Passthrough) {
+    // autoplugging stops at a sink that accepts the stream. one that takes
+    // any caps doesn't count, so fakesink can't do this
+    GstCaps* caps = gst_caps_from_string(kEncodedCaps);
+    g_object_set(G_OBJECT(sink), "caps", caps, nullptr);
+    gst_caps_unref(caps);
+  }
+  return sink;
+}
+
+void SinkProfile::DemoteHardwareDecoders() const
+{
+  GList* decoders = gst_element_factory_list_get_elements(
+    GST_ELEMENT_FACTORY_TYPE_DECODER, GST_RANK_NONE);
+  for (GList* i = decoders; i; i = i->next) {
+    GstElementFactory* factory = GST_ELEMENT_FACTORY(i->data);
+    if (IsHardwareDecoder(factory)) {
+      SB_DLOG(INFO) << "not autoplugging "
+        << gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory));
+      gst_plugin_feature_set_rank(GST_PLUGIN_FEATURE(factory), GST_RANK_NONE);
+    }
+  }
+  gst_plugin_feature_list_free(decoders);
+}
+
+std::string SinkProfile::ToString() const
+{
+  std::string description;
+  switch (Type) {
+  case kDevice:
+    description = "device";
+    break;
+  case kFakeSink:
+    description = "fakesink";
+    break;
+  case kAppSink:
+    description = "appsink";
+    break;
+  }
+  if (IsHeadless()) {
+    description += Sync ? ",sync" : ",nosync";
+  }
+  description += SoftwareDecoders ? ",software" : ",hardware";
+  if (Passthrough) {
+    description += ",passthrough";
+  }
+  return description;
+}
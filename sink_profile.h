@@ -0,0 +1,83 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <gst/gst.h>
+
+#include <string>
+
+// Which sinks and decoders the players use. The default drives the Pi:
+// westerossink on the compositor, omxhdmiaudiosink and the OMX decoders.
+// The headless profiles replace both sinks with fakesink or appsink and
+// may force software decoders, so the media path runs and can be measured
+// on any Linux box. Selected by --media_sink_profile or
+// COBALT_MEDIA_SINK_PROFILE, as a comma separated list:
+//   device | fakesink | appsink   the sinks, device by default
+//   sync | nosync                 headless sinks follow the clock or not
+//   software | hardware           decoder choice, software when headless
+//   passthrough                   appsink takes the streams as written, no
+//                                 parsers or decoders, for benchmarking the
+//                                 ingest path
+// e.g. --media_sink_profile=fakesink,nosync
+class SinkProfile
+{
+public:
+  enum Sinks
+  {
+    kDevice,
+    kFakeSink,
+    kAppSink
+  };
+
+  // the current profile, fixed once the players run
+  static const SinkProfile& Get();
+  // after gst_init, before the first player: reads the switch and ranks
+  // the decoders for the profile
+  static void Configure(int argc, char** argv);
+
+  bool IsHeadless() const {
+    return Type != kDevice;
+  }
+  // the appsinks accept the encoded streams, nothing decodes them
+  bool IsPassthrough() const {
+    return Passthrough;
+  }
+  const char* GetVideoSinkName() const;
+  const char* GetAudioSinkName() const;
+  // the sinks for a new pipeline, floating
+  GstElement* CreateVideoSink() const;
+  GstElement* CreateAudioSink() const;
+  std::string ToString() const;
+
+private:
+  SinkProfile();
+  // the environment until Configure sees the switch
+  static SinkProfile& Selected();
+  static SinkProfile Parse(const char* description);
+  GstElement* CreateHeadlessSink(const char* name) const;
+  // takes the hardware decoders out of autoplugging
+  void DemoteHardwareDecoders() const;
+
+  Sinks Type;
+  bool Sync;
+  bool SoftwareDecoders;
+  bool Passthrough;
+};
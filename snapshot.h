@@ -0,0 +1,89 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+#include "starboard/common/mutex.h"
+
+#include <cstdint>
+
+// Value of a plain (trivially copyable) type, written by few and read by
+// many threads. Two slots are used in turn: a store fills the slot readers
+// are not looking at and then publishes it, so a reader only retries when
+// two stores complete during its copy and never waits for a writer.
+// Stores are serialized, but are rare compared to loads.
+template <typename T>
+class Snapshot
+{
+public:
+  Snapshot() : Started(0), Published(0)
+  {
+    Slots[0] = T();
+    Slots[1] = T();
+  }
+
+  T Load() const
+  {
+    T value;
+    for (;;) {
+      const uint32_t published
+        = static_cast<uint32_t>(SbAtomicAcquire_Load(&Published));
+      value = Slots[published & 1];
+      // the copy has to be complete before looking for a writer
+      SbAtomicMemoryBarrier();
+      const uint32_t started
+        = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&Started));
+      // the next store goes to the other slot, only the one after that
+      // overwrites what was just copied
+      if (started - published <= 1) {
+        return value;
+      }
+    }
+  }
+
+  void Store(const T& value)
+  {
+    starboard::ScopedLock lock(WriteMutex);
+    const uint32_t next
+      = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&Published)) + 1;
+    SbAtomicNoBarrier_Store(&Started, static_cast<SbAtomic32>(next));
+    SbAtomicMemoryBarrier();
+    Slots[next & 1] = value;
+    SbAtomicRelease_Store(&Published, static_cast<SbAtomic32>(next));
+  }
+
+  operator T() const {
+    return Load();
+  }
+  T operator =(const T& value) {
+    Store(value);
+    return value;
+  }
+
+private:
+  T Slots[2];
+  SbAtomic32 Started;
+  SbAtomic32 Published;
+  starboard::Mutex WriteMutex;
+
+  Snapshot(const Snapshot&) = delete;
+  Snapshot& operator=(const Snapshot&) = delete;
+};
@@ -0,0 +1,82 @@
+//
+// If not stated otherwise in this file or this component's LICENSE file the
+// following copyright and licenses apply:
+//
+// Copyright 2019 RDK Management
+// Copyright 2019 Liberty Global B.V.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include "starboard/atomic.h"
+
+#include <cstdint>
+
+// Bounded lock free single producer / single consumer ring. Push must only
+// be called from one thread and Pop from one (other) thread, neither blocks.
+// N has to be a power of two.
+template <typename T, int N>
+class SpscRing
+{
+public:
+  SpscRing() : Head(0), Tail(0)
+  {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+  }
+
+  bool Push(const T& item)
+  {
+    const uint32_t head = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&Head));
+    const uint32_t tail = static_cast<uint32_t>(SbAtomicAcquire_Load(&Tail));
+    if (head - tail >= static_cast<uint32_t>(N)) {
+      return false;
+    }
+    Items[head & (N - 1)] = item;
+    SbAtomicRelease_Store(&Head, static_cast<SbAtomic32>(head + 1));
+    return true;
+  }
+
+  bool Pop(T* item)
+  {
+    const uint32_t tail = static_cast<uint32_t>(SbAtomicNoBarrier_Load(&Tail));
+    const uint32_t head = static_cast<uint32_t>(SbAtomicAcquire_Load(&Head));
+    if (head == tail) {
+      return false;
+    }
+    *item = Items[tail & (N - 1)];
+    SbAtomicRelease_Store(&Tail, static_cast<SbAtomic32>(tail + 1));
+    return true;
+  }
+
+  // approximate when called concurrently with Push or Pop
+  int Size() const
+  {
+    const uint32_t tail = static_cast<uint32_t>(SbAtomicAcquire_Load(&Tail));
+    const uint32_t head = static_cast<uint32_t>(SbAtomicAcquire_Load(&Head));
+    return static_cast<int>(head - tail);
+  }
+
+  static int Capacity() {
+    return N;
+  }
+
+private:
+  SbAtomic32 Head;
+  SbAtomic32 Tail;
+  T Items[N];
+
+  SpscRing(const SpscRing&) = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+};
@@ -43,10 +43,23 @@
         '<(DEPTH)/third_party/starboard/raspi/wayland/application_wayland.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/abstract_decoder.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/audio_decoder.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/buffering_controller.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/cobalt_source.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/command_queue.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/latency_histogram.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/media_capabilities.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/media_preload.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/media_reactor.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/pipeline_builder.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/pipeline_pool.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/video_decoder.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/player_interface.cc',
         '<(DEPTH)/third_party/starboard/raspi/wayland/player_private.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/qos_tracker.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/queue_limiter.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/sample_pool.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/sample_window.cc',
+        '<(DEPTH)/third_party/starboard/raspi/wayland/sink_profile.cc',
         '<(DEPTH)/starboard/shared/starboard/link_receiver.cc',
         '<(DEPTH)/starboard/shared/wayland/dev_input.cc',
         '<(DEPTH)/starboard/shared/wayland/egl_workaround.cc',
@@ -290,7 +303,6 @@
         '<(DEPTH)/starboard/shared/starboard/player/job_queue.cc',
         '<(DEPTH)/starboard/shared/starboard/player/job_queue.h',
         '<(DEPTH)/starboard/shared/starboard/player/player_get_info2.cc',
-        '<(DEPTH)/starboard/shared/starboard/player/player_get_maximum_number_of_samples_per_write.cc',
         '<(DEPTH)/starboard/shared/starboard/player/player_internal.h',
         '<(DEPTH)/starboard/shared/starboard/player/player_seek2.cc',
         '<(DEPTH)/starboard/shared/starboard/player/player_worker.cc',
@@ -365,6 +377,28 @@
         '-Wno-unused-variable',
       ],
     },
+    {
+      # micro benchmarks of the player hot paths, not part of the port
+      'target_name': 'media_microbenchmark',
+      'type': 'executable',
+      'sources': [
+        '<(DEPTH)/third_party/starboard/raspi/wayland/microbenchmark.cc',
+      ],
+      'dependencies': [
+        '<(DEPTH)/starboard/starboard.gyp:starboard',
+      ],
+    },
+    {
+      # end to end benchmark of the players with synthetic streams, headless
+      'target_name': 'media_benchmark',
+      'type': 'executable',
+      'sources': [
+        '<(DEPTH)/third_party/starboard/raspi/wayland/media_benchmark.cc',
+      ],
+      'dependencies': [
+        '<(DEPTH)/starboard/starboard.gyp:starboard',
+      ],
+    },
   ],
   'target_defaults': {
     'include_dirs!': [
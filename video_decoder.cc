@@ -20,6 +20,8 @@
 //
 
 #include "third_party/starboard/raspi/wayland/video_decoder.h"
+#include "third_party/starboard/raspi/wayland/media_capabilities.h"
+#include "third_party/starboard/raspi/wayland/media_preload.h"
 
 #include "starboard/shared/starboard/media/media_support_internal.h"
 
@@ -64,25 +66,87 @@ SB_EXPORT bool SbMediaIsVideoSupported(SbMediaVideoCodec videoCodec,
 #endif  // SB_API_VERSION >= 10
                                        )
 {
-  const bool result = (videoCodec == kSbMediaVideoCodecH264
-                       || videoCodec == kSbMediaVideoCodecMpeg2
-			|| videoCodec == kSbMediaVideoCodecVc1
-                       || videoCodec == kSbMediaVideoCodecVp8)
-    && frameWidth >= 0 && frameWidth <= 5000
-    && frameHeight >= 0 && frameHeight <= 5000
-    && bitrate >= 0 && bitrate <= SB_MEDIA_MAX_VIDEO_BITRATE_IN_BITS_PER_SECOND
-    && fps >= 0 && fps <= 60;
+  MediaPreload::Wait();
+  // codecs and limits of the installed decoders, see MediaCapabilities
+  const bool result = MediaCapabilities::Get().IsVideoSupported(
+      videoCodec, frameWidth, frameHeight, fps)
+    && bitrate >= 0 && bitrate <= SB_MEDIA_MAX_VIDEO_BITRATE_IN_BITS_PER_SECOND;
   return result;
 }
 
 VideoDecoder::VideoDecoder(SbPlayerPrivate& player)
-  : AbstractDecoder(player, kSbMediaTypeVideo)
+  : AbstractDecoder(player, kSbMediaTypeVideo),
+  BaseCaps(nullptr),
+  FrameWidth(0),
+  FrameHeight(0),
+  LastPts(GST_CLOCK_TIME_NONE),
+  FrameDuration(GST_CLOCK_TIME_NONE)
 {
 }
 
+VideoDecoder::~VideoDecoder()
+{
+  if (BaseCaps) {
+    gst_caps_unref(BaseCaps);
+  }
+}
+
+void VideoDecoder::PrepareBuffer(GstBuffer* buffer,
+                                 const SbMediaVideoSampleInfo* info)
+{
+  const GstClockTime pts = GST_BUFFER_PTS(buffer);
+  if (GST_CLOCK_TIME_IS_VALID(LastPts) && GST_CLOCK_TIME_IS_VALID(pts)) {
+    const GstClockTime delta = pts > LastPts ? pts - LastPts : LastPts - pts;
+    if (delta > 0 && (!GST_CLOCK_TIME_IS_VALID(FrameDuration)
+                      || delta < FrameDuration)) {
+      FrameDuration = delta;
+    }
+  }
+  LastPts = pts;
+
+  // DTS stays unset, Cobalt gives none and with B frames it can't be told
+  // from the PTS of the samples seen so far. the parsers derive it
+  if (GST_CLOCK_TIME_IS_VALID(FrameDuration)) {
+    GST_BUFFER_DURATION(buffer) = FrameDuration;
+  }
+  if (!info) {
+    return;
+  }
+  if (!info->is_key_frame) {
+    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  if (info->frame_width > 0 && info->frame_height > 0
+      && (info->frame_width != FrameWidth
+          || info->frame_height != FrameHeight)) {
+    if (info->frame_height != FrameHeight) {
+      Buffering.Configure(Player.GetVideoCodec(), info->frame_height);
+    }
+    FrameWidth = info->frame_width;
+    FrameHeight = info->frame_height;
+    if (BaseCaps) {
+      GstCaps* caps = gst_caps_copy(BaseCaps);
+      gst_caps_set_simple(caps,
+                          "width", G_TYPE_INT, FrameWidth,
+                          "height", G_TYPE_INT, FrameHeight,
+                          nullptr);
+      UpdateCaps(caps);
+    }
+  }
+}
+
+void VideoDecoder::OnFlush()
+{
+  // the frame size is announced again with the first sample after a seek
+  FrameWidth = 0;
+  FrameHeight = 0;
+  LastPts = GST_CLOCK_TIME_NONE;
+}
+
 GstCaps* VideoDecoder::CustomInitialize()
 {
-  g_object_set(Source, "min-percent", 60u, "max-bytes", 256ull << 10, NULL);
+  // the amount of data is driven by media time, see BufferingController
+  Buffering.Configure(Player.GetVideoCodec(), FrameHeight);
 
   const char* type = nullptr;
   GstCaps* caps = nullptr;
@@ -109,6 +173,7 @@ GstCaps* VideoDecoder::CustomInitialize()
   if (!caps) {
     caps = gst_caps_new_empty_simple(type);
   }
+  BaseCaps = gst_caps_ref(caps);
 
 #if 0
   gchar* c = gst_caps_to_string(caps);
@@ -27,9 +27,21 @@ class VideoDecoder : public AbstractDecoder
 {
 public:
   VideoDecoder(SbPlayerPrivate& player);
-  virtual ~VideoDecoder() {}
+  virtual ~VideoDecoder();
+
+  virtual void PrepareBuffer(GstBuffer* buffer,
+                             const SbMediaVideoSampleInfo* info) override;
 
 private:
   virtual GstCaps* CustomInitialize() override;
+  virtual void OnFlush() override;
+
+  // caps without the frame size
+  GstCaps* BaseCaps;
+  int FrameWidth;
+  int FrameHeight;
+  GstClockTime LastPts;
+  // smallest distance between two samples seen so far
+  GstClockTime FrameDuration;
 };
 